@@ -0,0 +1,49 @@
+#pragma once
+
+/* Non-blocking LED/indicator service ที่ทุก lab ใช้ร่วมกัน
+   ผู้เรียกโพสต์คำขอ pulse/pattern ลง ring แบบ lock-free แล้วกลับทันที;
+   task priority ต่ำตัวเดียวเป็นคนสั่ง GPIO และจับเวลาดับไฟ
+   -> hot path / timer daemon ไม่ต้อง vTaskDelay เพื่อกระพริบไฟอีก
+
+   เพิ่มในโปรเจกต์ด้วย (ก่อน include project.cmake):
+       set(EXTRA_COMPONENT_DIRS ../components/indicator)
+   ผู้เรียกยังต้อง gpio_set_direction() ขาเองเหมือนเดิม */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INDICATOR_RING_SIZE      32    // pending requests, power of two
+#define INDICATOR_MAX_ACTIVE     16    // pins animating at the same time
+#define INDICATOR_TASK_PRIORITY  1
+#define INDICATOR_TASK_STACK     2048
+
+typedef struct {
+    uint32_t posted;
+    uint32_t dropped;        // ring full, request discarded
+    uint32_t replaced;       // new request for a pin that was still animating
+    uint32_t max_pending;    // deepest the ring got
+} indicator_stats_t;
+
+/* สร้าง task ระบายคิว (เรียกซ้ำได้); false = สร้าง task ไม่สำเร็จ */
+bool indicator_init(UBaseType_t priority);
+
+/* ไฟติด on_ms แล้วดับ; false = ring เต็ม (ไม่บล็อก ไม่ retry) */
+bool indicator_pulse(gpio_num_t pin, uint16_t on_ms);
+
+/* กระพริบ repeats รอบ (ติด on_ms, ดับ off_ms); คำขอใหม่ของขาเดิมแทนที่รูปแบบเก่า */
+bool indicator_pattern(gpio_num_t pin, uint16_t on_ms, uint16_t off_ms, uint8_t repeats);
+
+/* เหมือน indicator_pulse แต่เรียกจาก ISR ได้ */
+bool indicator_pulse_from_isr(gpio_num_t pin, uint16_t on_ms);
+
+void indicator_get_stats(indicator_stats_t* out);
+
+#ifdef __cplusplus
+}
+#endif
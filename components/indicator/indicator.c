@@ -0,0 +1,196 @@
+#include <string.h>
+#include "indicator.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "INDICATOR";
+
+_Static_assert((INDICATOR_RING_SIZE & (INDICATOR_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+#define RING_MASK (INDICATOR_RING_SIZE - 1)
+
+typedef struct {
+    gpio_num_t pin;
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint8_t repeats;
+} indicator_req_t;
+
+/* ---------------- Lock-free ring ----------------
+   bounded MPSC ring แบบมี sequence ต่อช่อง: ผู้เขียนหลายตัว (task/ISR ทั้งสอง core) จองช่องด้วย CAS บน enq_pos
+   แล้ว publish ด้วย seq; ผู้อ่านมีตัวเดียว (indicator_task) จึงเลื่อน deq_pos ได้โดยไม่ต้อง CAS */
+typedef struct {
+    uint32_t seq;            // == pos: ว่างรอเขียน, == pos+1: มีข้อมูลรออ่าน
+    indicator_req_t req;
+} ring_slot_t;
+
+static ring_slot_t ring[INDICATOR_RING_SIZE];
+static uint32_t enq_pos;
+static uint32_t deq_pos;
+
+/* ---------------- Drain task state (indicator_task only) ---------------- */
+typedef struct {
+    bool active;
+    bool level;
+    gpio_num_t pin;
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint8_t remaining;       // on-phases left including the current one
+    int64_t deadline_us;
+} indicator_slot_t;
+
+static indicator_slot_t active[INDICATOR_MAX_ACTIVE];
+static TaskHandle_t indicator_task_handle = NULL;
+static indicator_stats_t stats;
+
+static inline bool IRAM_ATTR ring_push(const indicator_req_t* r)
+{
+    uint32_t pos = __atomic_load_n(&enq_pos, __ATOMIC_RELAXED);
+    ring_slot_t* slot;
+    for (;;) {
+        slot = &ring[pos & RING_MASK];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&enq_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return false;    // เต็ม: ไฟดวงนี้ไม่กระพริบ ดีกว่าให้ผู้เรียกรอ
+        } else {
+            pos = __atomic_load_n(&enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->req = *r;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    uint32_t pending = pos + 1 - __atomic_load_n(&deq_pos, __ATOMIC_RELAXED);
+    if (pending > stats.max_pending) stats.max_pending = pending;   // approximate under contention
+    __atomic_fetch_add(&stats.posted, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static bool ring_pop(indicator_req_t* out)
+{
+    ring_slot_t* slot = &ring[deq_pos & RING_MASK];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != deq_pos + 1) return false;
+    *out = slot->req;
+    __atomic_store_n(&slot->seq, deq_pos + INDICATOR_RING_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&deq_pos, deq_pos + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void apply_request(const indicator_req_t* r, int64_t now)
+{
+    indicator_slot_t* s = NULL;
+    for (int i = 0; i < INDICATOR_MAX_ACTIVE; i++) {
+        if (active[i].active && active[i].pin == r->pin) {
+            s = &active[i];
+            stats.replaced++;
+            break;
+        }
+        if (!s && !active[i].active) s = &active[i];
+    }
+    if (!s) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    s->active = true;
+    s->level = true;
+    s->pin = r->pin;
+    s->on_ms = r->on_ms;
+    s->off_ms = r->off_ms;
+    s->remaining = r->repeats ? r->repeats : 1;
+    s->deadline_us = now + (int64_t)r->on_ms * 1000;
+    gpio_set_level(r->pin, 1);
+}
+
+static void step_slot(indicator_slot_t* s, int64_t now)
+{
+    if (s->level) {
+        gpio_set_level(s->pin, 0);
+        s->level = false;
+        if (--s->remaining == 0) {
+            s->active = false;
+            return;
+        }
+        s->deadline_us = now + (int64_t)s->off_ms * 1000;
+    } else {
+        gpio_set_level(s->pin, 1);
+        s->level = true;
+        s->deadline_us = now + (int64_t)s->on_ms * 1000;
+    }
+}
+
+static void indicator_task(void* arg)
+{
+    for (;;) {
+        indicator_req_t req;
+        int64_t now = esp_timer_get_time();
+        while (ring_pop(&req)) apply_request(&req, now);
+
+        int64_t next = INT64_MAX;
+        for (int i = 0; i < INDICATOR_MAX_ACTIVE; i++) {
+            indicator_slot_t* s = &active[i];
+            if (s->active && now >= s->deadline_us) step_slot(s, now);
+            if (s->active && s->deadline_us < next) next = s->deadline_us;
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (next != INT64_MAX) {
+            wait = pdMS_TO_TICKS((next - now + 999) / 1000);
+            if (wait == 0) wait = 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+bool indicator_init(UBaseType_t priority)
+{
+    if (indicator_task_handle) return true;
+    for (uint32_t i = 0; i < INDICATOR_RING_SIZE; i++) ring[i].seq = i;
+    enq_pos = deq_pos = 0;
+    memset(active, 0, sizeof(active));
+    if (xTaskCreate(indicator_task, "Indicator", INDICATOR_TASK_STACK, NULL, priority,
+                    &indicator_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "failed to create indicator task");
+        indicator_task_handle = NULL;
+        return false;
+    }
+    ESP_LOGI(TAG, "💡 indicator service ready (ring %d, %d pins, prio %u)",
+             INDICATOR_RING_SIZE, INDICATOR_MAX_ACTIVE, (unsigned)priority);
+    return true;
+}
+
+bool indicator_pattern(gpio_num_t pin, uint16_t on_ms, uint16_t off_ms, uint8_t repeats)
+{
+    if (!indicator_task_handle) return false;
+    indicator_req_t r = { pin, on_ms, off_ms, repeats };
+    if (!ring_push(&r)) return false;
+    xTaskNotifyGive(indicator_task_handle);
+    return true;
+}
+
+bool indicator_pulse(gpio_num_t pin, uint16_t on_ms)
+{
+    return indicator_pattern(pin, on_ms, 0, 1);
+}
+
+bool IRAM_ATTR indicator_pulse_from_isr(gpio_num_t pin, uint16_t on_ms)
+{
+    if (!indicator_task_handle) return false;
+    indicator_req_t r = { pin, on_ms, 0, 1 };
+    if (!ring_push(&r)) return false;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(indicator_task_handle, &woken);
+    if (woken) portYIELD_FROM_ISR();
+    return true;
+}
+
+void indicator_get_stats(indicator_stats_t* out)
+{
+    out->posted      = __atomic_load_n(&stats.posted, __ATOMIC_RELAXED);
+    out->dropped     = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    out->replaced    = stats.replaced;
+    out->max_pending = stats.max_pending;
+}
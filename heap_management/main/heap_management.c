@@ -10,6 +10,7 @@
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_system.h"
+#include "esp_cpu.h"
 #include "esp_random.h"     // ✅ เพิ่มบรรทัดนี้เพื่อแก้ esp_random()
 #include "driver/gpio.h"
 
@@ -26,7 +27,22 @@ static const char *TAG = "HEAP_MGMT";
 #define LOW_MEMORY_THRESHOLD    50000    // 50KB
 #define CRITICAL_MEMORY_THRESHOLD 20000  // 20KB
 #define FRAGMENTATION_THRESHOLD 0.3      // 30% fragmentation
-#define MAX_ALLOCATIONS         100
+
+// Per-task tracking shards (FreeRTOS thread-local storage pointer)
+#if CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS < 2
+#error "heap_management needs CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS >= 2 (index 0 is reserved for pthreads)"
+#endif
+#define TRACK_TLS_INDEX         1        // index 0 สงวนให้ pthread TLS -> sdkconfig ตั้ง TLS pointers = 2
+#define SHARD_INITIAL_ALLOCATIONS 64     // slots ตอนสร้าง shard; เต็มแล้วโตทีละเท่าตัว
+#define SHARD_MAX_ALLOCATIONS   1024     // tracked live allocations per task (เท่าตาราง global เดิม)
+#define SHARD_LOG_RING          16       // alloc/free events kept for the monitor to print
+#define OWNER_MAP_BITS          11       // ptr -> owner shard: 2048 buckets, load <= 0.5 at 1024 live
+#define OWNER_MAP_SIZE          (1u << OWNER_MAP_BITS)
+#define MAX_ALLOC_SITES         32       // distinct call sites; ที่เกินนับรวมใน site 0 ("other")
+#define ALLOC_SITE_HASH_BITS    6
+#define ALLOC_SITE_HASH_SIZE    (1u << ALLOC_SITE_HASH_BITS)
+#define ALLOC_SITE_TOP_N        5
+#define TRACK_BENCH_OPS         50       // malloc+free pairs per variant in the overhead benchmark
 
 // Memory allocation tracking
 typedef struct {
@@ -35,9 +51,21 @@ typedef struct {
     uint32_t caps;
     const char* description;
     uint64_t timestamp;
+    uint8_t site;            // index ใน alloc_sites[]
     bool is_active;
 } memory_allocation_t;
 
+// Per call-site accounting: key = address ของคำสั่ง call ใน caller (ถอดด้วย addr2line / idf.py monitor)
+typedef struct {
+    uintptr_t pc;
+    const char* label;       // description ตัวแรกที่เห็นจาก site นี้
+    uint32_t live_bytes;
+    uint32_t live_count;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t last_alloc_count;   // ค่า alloc_count ตอน monitor พิมพ์รอบก่อน
+} alloc_site_t;
+
 // Memory statistics
 typedef struct {
     uint32_t total_allocations;
@@ -49,68 +77,403 @@ typedef struct {
     uint32_t allocation_failures;
     uint32_t fragmentation_events;
     uint32_t low_memory_events;
+    uint32_t untracked_allocations;   // tracker full: allocated but not recorded
+    uint32_t max_probe;               // longest hash probe seen
+    uint32_t cross_task_frees;        // freed by a task other than the allocating one
+    uint32_t untracked_frees;         // freed but never recorded (or freed twice)
 } memory_stats_t;
 
+typedef enum {
+    TRACK_EV_ALLOC,
+    TRACK_EV_FREE,
+    TRACK_EV_FAIL,
+    TRACK_EV_FULL,
+    TRACK_EV_UNTRACKED_FREE,
+} track_event_type_t;
+
+// log ที่เลื่อนไปพิมพ์ทีหลัง: hot path แค่เขียน struct ลง ring ของ task ตัวเอง
+typedef struct {
+    track_event_type_t type;
+    void* ptr;
+    size_t size;
+    const char* description;
+    int slot;
+} track_event_t;
+
+// ตารางของ task หนึ่งตัว: เจ้าของเข้าถึงเกือบคนเดียว spinlock จึงแทบไม่เคยชน
+// (ชนเฉพาะตอน task อื่น free ของที่ task นี้จอง หรือ monitor มา merge)
+typedef struct tracking_shard {
+    struct tracking_shard* next;      // registry แบบ append-only: เดินได้โดยไม่ต้องล็อก
+    char task_name[configMAX_TASK_NAME_LEN];
+    bool orphaned;                    // task ถูกลบแล้ว, รอ task ใหม่มารับช่วง
+    portMUX_TYPE lock;
+
+    // ตารางเป็นก้อนเดียวบน heap ขนาดตาม capacity: task ที่จองน้อยไม่ต้องจ่าย RAM เต็ม 1024 ช่อง
+    uint32_t capacity;                // SHARD_INITIAL_ALLOCATIONS .. SHARD_MAX_ALLOCATIONS (เปลี่ยนโดยเจ้าของเท่านั้น)
+    uint32_t hash_bits;               // buckets = 2 × capacity: load factor <= 0.5 even when full
+    memory_allocation_t* allocations;
+    // ptr -> slot: open addressing (linear probing), ค่า = slot+1, 0 = ว่าง
+    uint16_t* alloc_index;
+    // slot ว่างเป็น stack: จอง/คืน slot ได้ O(1) ไม่ต้องสแกน allocations[]
+    uint16_t* free_slots;
+    int free_slot_top;
+    uint32_t grows;
+
+    memory_stats_t stats;             // เฉพาะตัวนับการจอง/คืนของ shard นี้
+    uint32_t site_live_bytes[MAX_ALLOC_SITES];
+    uint32_t site_live_count[MAX_ALLOC_SITES];
+    uint32_t site_allocs[MAX_ALLOC_SITES];
+    uint32_t site_frees[MAX_ALLOC_SITES];
+
+    track_event_t log[SHARD_LOG_RING];
+    uint32_t log_head;                // next write
+    uint32_t log_tail;                // next read (monitor)
+    uint32_t log_dropped;
+} tracking_shard_t;
+
 // Global variables
-static memory_allocation_t allocations[MAX_ALLOCATIONS];
+static tracking_shard_t* shard_registry = NULL;
+static alloc_site_t alloc_sites[MAX_ALLOC_SITES];      // pc/label เท่านั้น ตัวนับอยู่ใน shard
+static int alloc_site_count = 1;                       // site 0 = other (table full)
+static uint8_t alloc_site_index[ALLOC_SITE_HASH_SIZE];  // pc -> site+1, 0 = ว่าง
+static portMUX_TYPE alloc_site_lock = portMUX_INITIALIZER_UNLOCKED;   // insert site ใหม่เท่านั้น
+static uint32_t tracked_live_bytes = 0;                 // atomic: ใช้หา peak รวมทุก task
+static uint32_t tracked_peak_bytes = 0;
+static uint32_t shardless_allocations = 0;              // สร้าง shard ไม่ได้ (heap หมด)
+static uint32_t untracked_frees = 0;                    // free ของที่ไม่อยู่ใน owner map (atomic)
+// ptr -> shard เจ้าของ: free ข้าม task ไปหา shard ถูกตัวทันที ไม่ต้องไล่ล็อกทุก shard
+// lock-free: ptr หนึ่งค่ามีชีวิตได้ทีละครั้ง จึงมีแค่คนจองที่ insert และคน free ที่ลบ
+static void* owner_keys[OWNER_MAP_SIZE];                // NULL = ว่าง, OWNER_TOMBSTONE = ถูกลบ
+static tracking_shard_t* owner_shards[OWNER_MAP_SIZE];
+#define OWNER_TOMBSTONE         ((void*)1)
 static memory_stats_t stats = {0};
-static SemaphoreHandle_t memory_mutex;
+static SemaphoreHandle_t memory_mutex;                  // tracker เดิมใน benchmark เท่านั้น
 static bool memory_monitoring_enabled = true;
 
 // ================= Memory Tracking =================
 
-int find_free_allocation_slot(void) {
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (!allocations[i].is_active) {
-            return i;
+static inline uint32_t alloc_hash(const void* ptr, uint32_t bits) {
+    // heap pointer ตรง 4/8 ไบต์: ตัดบิตล่างทิ้งแล้วคูณ Fibonacci ให้บิตบนกระจาย
+    return ((uint32_t)((uintptr_t)ptr >> 3) * 2654435761u) >> (32 - bits);
+}
+
+void alloc_table_init(void) {
+    memset(alloc_sites, 0, sizeof(alloc_sites));
+    memset(alloc_site_index, 0, sizeof(alloc_site_index));
+    alloc_sites[0].label = "other";
+    alloc_site_count = 1;
+}
+
+// ค้น site ของ pc; ไม่เจอคืน -1 พร้อม bucket ว่างที่ต้องใส่ (UINT32_MAX = hash เต็ม)
+static int alloc_site_probe(uintptr_t pc, uint32_t* empty_bucket) {
+    uint32_t h = ((uint32_t)pc * 2654435761u) >> (32 - ALLOC_SITE_HASH_BITS);
+    for (uint32_t probe = 0; probe < ALLOC_SITE_HASH_SIZE; probe++) {
+        uint32_t b = (h + probe) & (ALLOC_SITE_HASH_SIZE - 1);
+        uint8_t v = __atomic_load_n(&alloc_site_index[b], __ATOMIC_ACQUIRE);
+        if (!v) {
+            *empty_bucket = b;
+            return -1;
         }
+        if (alloc_sites[v - 1].pc == pc) return v - 1;
     }
+    *empty_bucket = UINT32_MAX;
     return -1;
 }
 
-int find_allocation_by_ptr(void* ptr) {
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (allocations[i].is_active && allocations[i].ptr == ptr) {
-            return i;
+// หา/สร้าง site ของ pc: ค้นแบบไม่ล็อก (site ไม่เคยถูกลบ, publish ด้วย release store)
+// ล็อกเฉพาะตอนเพิ่ม site ใหม่ ซึ่งเกิดไม่กี่ครั้งตลอดอายุโปรแกรม
+static int alloc_site_lookup(uintptr_t pc, const char* label) {
+    uint32_t b;
+    int site = alloc_site_probe(pc, &b);
+    if (site >= 0) return site;
+
+    portENTER_CRITICAL(&alloc_site_lock);
+    site = alloc_site_probe(pc, &b);   // อาจมี task อื่นเพิ่งเพิ่มไป
+    if (site < 0) {
+        site = 0;
+        if (b != UINT32_MAX && alloc_site_count < MAX_ALLOC_SITES) {
+            site = alloc_site_count;
+            alloc_sites[site].pc = pc;
+            alloc_sites[site].label = label;
+            __atomic_store_n(&alloc_site_count, site + 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&alloc_site_index[b], (uint8_t)(site + 1), __ATOMIC_RELEASE);
+        }
+    }
+    portEXIT_CRITICAL(&alloc_site_lock);
+    return site;
+}
+
+// ก้อนเดียว: allocations[capacity] | free_slots[capacity] | alloc_index[2 × capacity]
+static void* shard_table_alloc(uint32_t capacity) {
+    return heap_caps_calloc(1, capacity * (sizeof(memory_allocation_t) + 3 * sizeof(uint16_t)),
+                            MALLOC_CAP_INTERNAL);
+}
+
+static void shard_table_bind(tracking_shard_t* shard, void* table, uint32_t capacity) {
+    shard->capacity = capacity;
+    shard->hash_bits = 32 - __builtin_clz(capacity);   // log2(capacity) + 1
+    shard->allocations = (memory_allocation_t*)table;
+    shard->free_slots = (uint16_t*)(shard->allocations + capacity);
+    shard->alloc_index = shard->free_slots + capacity;
+}
+
+static bool shard_init(tracking_shard_t* shard) {
+    void* table = shard_table_alloc(SHARD_INITIAL_ALLOCATIONS);
+    if (!table) return false;
+    shard_table_bind(shard, table, SHARD_INITIAL_ALLOCATIONS);
+    for (int i = 0; i < SHARD_INITIAL_ALLOCATIONS; i++) {
+        shard->free_slots[i] = (uint16_t)(SHARD_INITIAL_ALLOCATIONS - 1 - i);   // slot 0 อยู่บนสุด
+    }
+    shard->free_slot_top = SHARD_INITIAL_ALLOCATIONS;
+    portMUX_INITIALIZE(&shard->lock);
+    return true;
+}
+
+// TLS deletion callback: task ถูกลบ แต่ของที่มันจองอาจยังถูก task อื่นถือ/free อยู่ -> เก็บ shard ไว้
+static void tracking_shard_orphan(int index, void* p) {
+    (void)index;
+    __atomic_store_n(&((tracking_shard_t*)p)->orphaned, true, __ATOMIC_RELEASE);
+}
+
+// shard ของ task ปัจจุบัน; ครั้งแรกรับช่วง shard กำพร้าที่ว่างแล้ว หรือจองใหม่ (นอก critical path ถัดไป)
+static tracking_shard_t* tracking_shard_get(bool create) {
+    tracking_shard_t* shard = pvTaskGetThreadLocalStoragePointer(NULL, TRACK_TLS_INDEX);
+    if (shard || !create) return shard;
+
+    for (tracking_shard_t* s = __atomic_load_n(&shard_registry, __ATOMIC_ACQUIRE); s; s = s->next) {
+        bool expected = true;
+        if (s->stats.current_allocations == 0 &&
+            __atomic_compare_exchange_n(&s->orphaned, &expected, false, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            shard = s;
+            break;
+        }
+    }
+    if (!shard) {
+        shard = heap_caps_calloc(1, sizeof(tracking_shard_t), MALLOC_CAP_INTERNAL);
+        if (!shard) return NULL;
+        if (!shard_init(shard)) {
+            heap_caps_free(shard);
+            return NULL;
+        }
+        shard->next = __atomic_load_n(&shard_registry, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&shard_registry, &shard->next, shard, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    strlcpy(shard->task_name, pcTaskGetName(NULL), sizeof(shard->task_name));
+    vTaskSetThreadLocalStoragePointerAndDelCallback(NULL, TRACK_TLS_INDEX, shard, tracking_shard_orphan);
+    return shard;
+}
+
+// ---- owner map (ไม่ล็อก) ----
+
+// ใส่ ptr พร้อม shard เจ้าของ; คืน bucket, -1 = map เต็ม -> ผู้เรียกถือว่า untracked
+static int owner_map_insert(void* ptr, tracking_shard_t* shard) {
+    uint32_t h = alloc_hash(ptr, OWNER_MAP_BITS);
+    for (uint32_t probe = 0; probe < OWNER_MAP_SIZE; probe++) {
+        uint32_t b = (h + probe) & (OWNER_MAP_SIZE - 1);
+        void* key = __atomic_load_n(&owner_keys[b], __ATOMIC_RELAXED);
+        while (key == NULL || key == OWNER_TOMBSTONE) {
+            if (__atomic_compare_exchange_n(&owner_keys[b], &key, ptr, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                // เขียน owner หลังจับ bucket ได้: คนอ่าน owner มีแค่คน free ซึ่งได้ ptr หลัง malloc คืนแล้ว
+                owner_shards[b] = shard;
+                return (int)b;
+            }
         }
     }
     return -1;
 }
 
+// หา bucket ของ ptr, -1 = ไม่มี (ไม่เคยถูก track หรือ free ซ้ำ)
+static int owner_map_find(const void* ptr) {
+    uint32_t h = alloc_hash(ptr, OWNER_MAP_BITS);
+    for (uint32_t probe = 0; probe < OWNER_MAP_SIZE; probe++) {
+        uint32_t b = (h + probe) & (OWNER_MAP_SIZE - 1);
+        void* key = __atomic_load_n(&owner_keys[b], __ATOMIC_ACQUIRE);
+        if (key == NULL) return -1;
+        if (key == ptr) return (int)b;
+    }
+    return -1;
+}
+
+static inline void owner_map_remove(int bucket) {
+    __atomic_store_n(&owner_keys[bucket], OWNER_TOMBSTONE, __ATOMIC_RELEASE);
+}
+
+// ---- ตารางใน shard (ต้องถือ shard->lock) ----
+
+// จอง slot ว่าง (pop จาก stack), -1 = เต็ม
+int find_free_allocation_slot(tracking_shard_t* shard) {
+    return shard->free_slot_top > 0 ? shard->free_slots[--shard->free_slot_top] : -1;
+}
+
+int find_allocation_by_ptr(tracking_shard_t* shard, void* ptr) {
+    const uint32_t mask = (1u << shard->hash_bits) - 1;
+    uint32_t h = alloc_hash(ptr, shard->hash_bits);
+    for (uint32_t probe = 0; probe <= mask; probe++) {
+        uint16_t v = shard->alloc_index[(h + probe) & mask];
+        if (v == 0) return -1;
+        if (shard->allocations[v - 1].ptr == ptr) return v - 1;
+    }
+    return -1;
+}
+
+static void alloc_index_insert(tracking_shard_t* shard, void* ptr, int slot) {
+    const uint32_t mask = (1u << shard->hash_bits) - 1;
+    uint32_t h = alloc_hash(ptr, shard->hash_bits);
+    uint32_t probe = 0;
+    while (shard->alloc_index[(h + probe) & mask]) probe++;   // ไม่เต็มเสมอ: buckets > slots
+    shard->alloc_index[(h + probe) & mask] = (uint16_t)(slot + 1);
+    if (probe > shard->stats.max_probe) shard->stats.max_probe = probe;
+}
+
+// ลบออกจาก hash แบบ backward-shift (ไม่มี tombstone) แล้วคืน slot เข้า stack
+static void release_allocation_slot(tracking_shard_t* shard, int slot) {
+    uint16_t* index = shard->alloc_index;
+    const uint32_t mask = (1u << shard->hash_bits) - 1;
+    uint32_t i = alloc_hash(shard->allocations[slot].ptr, shard->hash_bits);
+    while (index[i] != slot + 1) i = (i + 1) & mask;
+    for (;;) {
+        uint32_t j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (index[j] == 0) {
+                index[i] = 0;
+                shard->allocations[slot].is_active = false;
+                shard->free_slots[shard->free_slot_top++] = (uint16_t)slot;
+                return;
+            }
+            uint32_t home = alloc_hash(shard->allocations[index[j] - 1].ptr, shard->hash_bits);
+            // ย้าย j มาที่ i ได้ถ้า home ของมันไม่อยู่ในช่วง (i, j]
+            if (((j - home) & mask) >= ((j - i) & mask)) break;
+        }
+        index[i] = index[j];
+        i = j;
+    }
+}
+
+// ตารางเต็ม: จองตารางใหญ่ขึ้นเท่าตัวนอก lock แล้วย้ายภายใต้ lock (slot คงเลขเดิม, สร้าง hash ใหม่)
+// เรียกจากเจ้าของ shard เท่านั้น; task อื่นแค่คืน slot จึงอ่าน capacity นอก lock ได้
+static bool shard_grow(tracking_shard_t* shard) {
+    const uint32_t old_cap = shard->capacity;
+    if (old_cap >= SHARD_MAX_ALLOCATIONS) return false;
+    const uint32_t new_cap = old_cap * 2;
+    void* table = shard_table_alloc(new_cap);
+    if (!table) return false;
+
+    portENTER_CRITICAL(&shard->lock);
+    void* old_table = shard->allocations;
+    const uint16_t* old_free = shard->free_slots;
+    const int old_top = shard->free_slot_top;
+    memcpy(table, shard->allocations, old_cap * sizeof(memory_allocation_t));
+    shard_table_bind(shard, table, new_cap);
+
+    int top = 0;
+    for (uint32_t slot = new_cap; slot-- > old_cap; ) shard->free_slots[top++] = (uint16_t)slot;
+    for (int i = 0; i < old_top; i++) shard->free_slots[top++] = old_free[i];   // ที่เพิ่งถูกคืนอยู่บนสุด
+    shard->free_slot_top = top;
+    for (uint32_t slot = 0; slot < old_cap; slot++) {
+        if (shard->allocations[slot].is_active) alloc_index_insert(shard, shard->allocations[slot].ptr, slot);
+    }
+    shard->grows++;
+    portEXIT_CRITICAL(&shard->lock);
+
+    heap_caps_free(old_table);
+    return true;
+}
+
+static void shard_log(tracking_shard_t* shard, track_event_type_t type, void* ptr, size_t size,
+                      const char* description, int slot) {
+    if (shard->log_head - shard->log_tail >= SHARD_LOG_RING) {
+        shard->log_dropped++;   // monitor ยังไม่มาอ่าน: ทิ้งดีกว่าให้ผู้จองรอ UART
+        return;
+    }
+    track_event_t* ev = &shard->log[shard->log_head++ % SHARD_LOG_RING];
+    ev->type = type;
+    ev->ptr = ptr;
+    ev->size = size;
+    ev->description = description;
+    ev->slot = slot;
+}
+
+static bool shard_untrack(tracking_shard_t* shard, void* ptr, const char* description) {
+    size_t size = 0;
+    portENTER_CRITICAL(&shard->lock);
+    int slot = find_allocation_by_ptr(shard, ptr);
+    if (slot >= 0) {
+        memory_allocation_t* a = &shard->allocations[slot];
+        size = a->size;
+        release_allocation_slot(shard, slot);
+        shard->stats.total_deallocations++;
+        shard->stats.current_allocations--;
+        shard->stats.total_bytes_deallocated += size;
+        shard->site_live_bytes[a->site] -= size;
+        shard->site_live_count[a->site]--;
+        shard->site_frees[a->site]++;
+        shard_log(shard, TRACK_EV_FREE, ptr, size, description, slot);
+    }
+    portEXIT_CRITICAL(&shard->lock);
+    if (slot >= 0) __atomic_fetch_sub(&tracked_live_bytes, size, __ATOMIC_RELAXED);
+    return slot >= 0;
+}
+
+// noinline: __builtin_return_address(0) ต้องเป็น caller จริง ไม่ใช่ตัวที่ inline เข้าไป
+__attribute__((noinline))
 void* tracked_malloc(size_t size, uint32_t caps, const char* description) {
+    uintptr_t call_pc = (uintptr_t)esp_cpu_get_call_addr((intptr_t)__builtin_return_address(0));
     void* ptr = heap_caps_malloc(size, caps);
-    
-    if (memory_monitoring_enabled && memory_mutex) {
-        if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            if (ptr) {
-                int slot = find_free_allocation_slot();
-                if (slot >= 0) {
-                    allocations[slot].ptr = ptr;
-                    allocations[slot].size = size;
-                    allocations[slot].caps = caps;
-                    allocations[slot].description = description;
-                    allocations[slot].timestamp = esp_timer_get_time();
-                    allocations[slot].is_active = true;
-                    
-                    stats.total_allocations++;
-                    stats.current_allocations++;
-                    stats.total_bytes_allocated += size;
-                    
-                    size_t current_usage = stats.total_bytes_allocated - stats.total_bytes_deallocated;
-                    if (current_usage > stats.peak_usage) {
-                        stats.peak_usage = current_usage;
-                    }
-                    
-                    ESP_LOGI(TAG, "✅ Allocated %d bytes at %p (%s) - Slot %d", 
-                             size, ptr, description, slot);
-                } else {
-                    ESP_LOGW(TAG, "⚠️ Allocation tracking full!");
-                }
-            } else {
-                stats.allocation_failures++;
-                ESP_LOGE(TAG, "❌ Failed to allocate %d bytes (%s)", size, description);
-            }
-            xSemaphoreGive(memory_mutex);
+    if (!memory_monitoring_enabled) return ptr;
+
+    tracking_shard_t* shard = tracking_shard_get(true);
+    if (!shard) {
+        __atomic_fetch_add(&shardless_allocations, 1, __ATOMIC_RELAXED);
+        return ptr;
+    }
+    int site = ptr ? alloc_site_lookup(call_pc, description) : 0;
+    uint64_t now = esp_timer_get_time();
+    if (ptr && shard->free_slot_top == 0) shard_grow(shard);   // ไม่สำเร็จ (ถึงเพดาน/heap หมด) -> FULL ข้างล่าง
+    int owner_bucket = ptr ? owner_map_insert(ptr, shard) : -1;   // owner map เต็ม -> FULL เหมือนกัน
+
+    portENTER_CRITICAL(&shard->lock);
+    if (ptr) {
+        int slot = owner_bucket >= 0 ? find_free_allocation_slot(shard) : -1;
+        if (slot >= 0) {
+            memory_allocation_t* a = &shard->allocations[slot];
+            a->ptr = ptr;
+            a->size = size;
+            a->caps = caps;
+            a->description = description;
+            a->timestamp = now;
+            a->site = (uint8_t)site;
+            a->is_active = true;
+            alloc_index_insert(shard, ptr, slot);
+
+            shard->stats.total_allocations++;
+            shard->stats.current_allocations++;
+            shard->stats.total_bytes_allocated += size;
+            shard->site_live_bytes[site] += size;
+            shard->site_live_count[site]++;
+            shard->site_allocs[site]++;
+            shard_log(shard, TRACK_EV_ALLOC, ptr, size, description, slot);
+        } else {
+            shard->stats.untracked_allocations++;
+            shard_log(shard, TRACK_EV_FULL, ptr, size, description, -1);
+            site = -1;
+        }
+    } else {
+        shard->stats.allocation_failures++;
+        shard_log(shard, TRACK_EV_FAIL, NULL, size, description, -1);
+    }
+    portEXIT_CRITICAL(&shard->lock);
+
+    if (owner_bucket >= 0 && site < 0) owner_map_remove(owner_bucket);   // ตาราง shard เต็ม: ไม่ต้องจำเจ้าของ
+    if (ptr && site >= 0) {
+        uint32_t live = __atomic_add_fetch(&tracked_live_bytes, size, __ATOMIC_RELAXED);
+        uint32_t peak = __atomic_load_n(&tracked_peak_bytes, __ATOMIC_RELAXED);
+        while (live > peak && !__atomic_compare_exchange_n(&tracked_peak_bytes, &peak, live, true,
+                                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
         }
     }
     return ptr;
@@ -118,26 +481,128 @@ void* tracked_malloc(size_t size, uint32_t caps, const char* description) {
 
 void tracked_free(void* ptr, const char* description) {
     if (!ptr) return;
-    
-    if (memory_monitoring_enabled && memory_mutex) {
-        if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            int slot = find_allocation_by_ptr(ptr);
-            if (slot >= 0) {
-                allocations[slot].is_active = false;
-                stats.total_deallocations++;
-                stats.current_allocations--;
-                stats.total_bytes_deallocated += allocations[slot].size;
-                ESP_LOGI(TAG, "🗑️ Freed %d bytes at %p (%s) - Slot %d", 
-                         allocations[slot].size, ptr, description, slot);
-            } else {
-                ESP_LOGW(TAG, "⚠️ Freeing untracked pointer %p (%s)", ptr, description);
+
+    if (memory_monitoring_enabled) {
+        // owner map บอก shard เจ้าของตรง ๆ: ล็อกแค่ shard เดียว ไม่ว่าใครเป็นคน free
+        tracking_shard_t* own = tracking_shard_get(false);
+        int bucket = owner_map_find(ptr);
+        tracking_shard_t* owner = bucket >= 0 ? owner_shards[bucket] : NULL;
+        if (owner && shard_untrack(owner, ptr, description)) {
+            owner_map_remove(bucket);
+            if (own && own != owner) {
+                portENTER_CRITICAL(&own->lock);
+                own->stats.cross_task_frees++;
+                portEXIT_CRITICAL(&own->lock);
+            }
+        } else {
+            // ไม่สร้าง shard บน free path: นับรวมไว้ ถ้า task นี้มี shard อยู่แล้วค่อยฝาก log
+            __atomic_fetch_add(&untracked_frees, 1, __ATOMIC_RELAXED);
+            if (own) {
+                portENTER_CRITICAL(&own->lock);
+                shard_log(own, TRACK_EV_UNTRACKED_FREE, ptr, 0, description, -1);
+                portEXIT_CRITICAL(&own->lock);
             }
-            xSemaphoreGive(memory_mutex);
         }
     }
     heap_caps_free(ptr);
 }
 
+// รวมตัวนับจากทุก shard (ล็อกทีละ shard สั้น ๆ) — เรียกจาก monitor เท่านั้น
+void tracking_merge(memory_stats_t* out, alloc_site_t* sites, int* site_count) {
+    memset(out, 0, sizeof(*out));
+    int n = __atomic_load_n(&alloc_site_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        sites[i] = alloc_sites[i];
+        sites[i].live_bytes = sites[i].live_count = sites[i].alloc_count = sites[i].free_count = 0;
+    }
+    for (tracking_shard_t* s = __atomic_load_n(&shard_registry, __ATOMIC_ACQUIRE); s; s = s->next) {
+        portENTER_CRITICAL(&s->lock);
+        out->total_allocations       += s->stats.total_allocations;
+        out->total_deallocations     += s->stats.total_deallocations;
+        out->current_allocations     += s->stats.current_allocations;
+        out->total_bytes_allocated   += s->stats.total_bytes_allocated;
+        out->total_bytes_deallocated += s->stats.total_bytes_deallocated;
+        out->allocation_failures     += s->stats.allocation_failures;
+        out->untracked_allocations   += s->stats.untracked_allocations;
+        out->cross_task_frees        += s->stats.cross_task_frees;
+        if (s->stats.max_probe > out->max_probe) out->max_probe = s->stats.max_probe;
+        for (int i = 0; i < n; i++) {
+            sites[i].live_bytes  += s->site_live_bytes[i];
+            sites[i].live_count  += s->site_live_count[i];
+            sites[i].alloc_count += s->site_allocs[i];
+            sites[i].free_count  += s->site_frees[i];
+        }
+        portEXIT_CRITICAL(&s->lock);
+    }
+    out->untracked_allocations += __atomic_load_n(&shardless_allocations, __ATOMIC_RELAXED);
+    out->untracked_frees = __atomic_load_n(&untracked_frees, __ATOMIC_RELAXED);
+    out->peak_usage = __atomic_load_n(&tracked_peak_bytes, __ATOMIC_RELAXED);
+    *site_count = n;
+}
+
+// พิมพ์ log ที่ค้างใน ring ของทุก task: ESP_LOG อยู่ที่นี่ ไม่ได้อยู่ใน tracked_malloc/free แล้ว
+void tracking_flush_logs(void) {
+    for (tracking_shard_t* s = __atomic_load_n(&shard_registry, __ATOMIC_ACQUIRE); s; s = s->next) {
+        track_event_t batch[SHARD_LOG_RING];
+        uint32_t n = 0, dropped;
+        portENTER_CRITICAL(&s->lock);
+        while (s->log_tail != s->log_head) batch[n++] = s->log[s->log_tail++ % SHARD_LOG_RING];
+        dropped = s->log_dropped;
+        s->log_dropped = 0;
+        portEXIT_CRITICAL(&s->lock);
+
+        for (uint32_t i = 0; i < n; i++) {
+            const track_event_t* ev = &batch[i];
+            switch (ev->type) {
+            case TRACK_EV_ALLOC:
+                ESP_LOGI(TAG, "✅ [%s] Allocated %d bytes at %p (%s) - Slot %d",
+                         s->task_name, ev->size, ev->ptr, ev->description, ev->slot);
+                break;
+            case TRACK_EV_FREE:
+                ESP_LOGI(TAG, "🗑️ [%s] Freed %d bytes at %p (%s) - Slot %d",
+                         s->task_name, ev->size, ev->ptr, ev->description, ev->slot);
+                break;
+            case TRACK_EV_FAIL:
+                ESP_LOGE(TAG, "❌ [%s] Failed to allocate %d bytes (%s)",
+                         s->task_name, ev->size, ev->description);
+                break;
+            case TRACK_EV_FULL:
+                ESP_LOGW(TAG, "⚠️ [%s] Allocation tracking full - %p (%s) untracked",
+                         s->task_name, ev->ptr, ev->description);
+                break;
+            case TRACK_EV_UNTRACKED_FREE:
+                ESP_LOGW(TAG, "⚠️ [%s] Freeing untracked pointer %p (%s)",
+                         s->task_name, ev->ptr, ev->description);
+                break;
+            }
+        }
+        if (dropped) ESP_LOGW(TAG, "[%s] %lu tracking log events dropped", s->task_name, dropped);
+    }
+}
+
+// สรุปต่อ task: ตารางของใครใกล้เต็ม/ล้น (FULL event ใน ring อาจถูกทิ้งไปแล้ว แต่ตัวนับนี้ไม่หาย)
+void print_tracking_shards(void) {
+    for (tracking_shard_t* s = __atomic_load_n(&shard_registry, __ATOMIC_ACQUIRE); s; s = s->next) {
+        portENTER_CRITICAL(&s->lock);
+        uint32_t live = s->stats.current_allocations;
+        uint32_t capacity = s->capacity;
+        uint32_t grows = s->grows;
+        uint32_t untracked = s->stats.untracked_allocations;
+        bool orphaned = s->orphaned;
+        portEXIT_CRITICAL(&s->lock);
+
+        if (untracked) {
+            ESP_LOGW(TAG, "🧵 [%s] %lu/%lu live (max %d, grew %lu×) | %lu untracked: per-task table full%s",
+                     s->task_name, live, capacity, SHARD_MAX_ALLOCATIONS, grows, untracked,
+                     orphaned ? " (orphaned)" : "");
+        } else {
+            ESP_LOGI(TAG, "🧵 [%s] %lu/%lu live (max %d, grew %lu×)%s",
+                     s->task_name, live, capacity, SHARD_MAX_ALLOCATIONS, grows,
+                     orphaned ? " (orphaned)" : "");
+        }
+    }
+}
+
 // ================= Memory Analysis =================
 
 void analyze_memory_status(void) {
@@ -184,6 +649,281 @@ void analyze_memory_status(void) {
     gpio_set_level(LED_SPIRAM_ACTIVE, spiram_free > 0);
 }
 
+// top-N call site ตาม live bytes และตามอัตราการจอง (allocs/s ตั้งแต่รอบที่แล้ว)
+void print_allocation_sites(const alloc_site_t* snap, int n) {
+    static int64_t last_us = 0;
+    int64_t now = esp_timer_get_time();
+    float dt = last_us ? (now - last_us) / 1e6f : 0.0f;
+    last_us = now;
+
+    uint8_t order[MAX_ALLOC_SITES];
+    float rate[MAX_ALLOC_SITES];
+    for (int i = 0; i < n; i++) {
+        order[i] = (uint8_t)i;
+        rate[i] = dt > 0 ? (snap[i].alloc_count - alloc_sites[i].last_alloc_count) / dt : 0.0f;
+        alloc_sites[i].last_alloc_count = snap[i].alloc_count;   // monitor เขียนคนเดียว
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        // selection sort เฉพาะ N ตัวแรก: pass 0 = live bytes, pass 1 = allocs/s
+        for (int i = 0; i < n && i < ALLOC_SITE_TOP_N; i++) {
+            int best = i;
+            for (int j = i + 1; j < n; j++) {
+                bool better = pass == 0 ? snap[order[j]].live_bytes > snap[order[best]].live_bytes
+                                        : rate[order[j]] > rate[order[best]];
+                if (better) best = j;
+            }
+            uint8_t t = order[i]; order[i] = order[best]; order[best] = t;
+        }
+        ESP_LOGI(TAG, "📍 Top call sites by %s:", pass == 0 ? "live bytes" : "allocations/s");
+        for (int i = 0; i < n && i < ALLOC_SITE_TOP_N; i++) {
+            const alloc_site_t* site = &snap[order[i]];
+            if (!site->alloc_count) continue;
+            ESP_LOGI(TAG, "  0x%08x %-12s live %6lu B in %3lu | allocs %5lu frees %5lu | %.2f/s",
+                     (unsigned)site->pc, site->label ? site->label : "?",
+                     site->live_bytes, site->live_count,
+                     site->alloc_count, site->free_count, rate[order[i]]);
+        }
+    }
+}
+
+// ---- Baseline สำหรับ benchmark: tracker แบบเดิมก่อนแยก shard (user-023/024) ----
+// ตาราง global 1024 ช่อง + hash, ทุกครั้งถือ memory_mutex กลาง (timeout 100 ms) และ ESP_LOGI ขณะถือ lock
+// คัดลอกมาตรง ๆ เพื่อให้ตัวเลข "ก่อน" วัดจากโค้ดเดิมจริง; ตารางจองตอนวัดแล้วคืน
+#define LEGACY_MAX_ALLOCATIONS  1024
+#define LEGACY_HASH_BITS        11
+#define LEGACY_HASH_SIZE        (1u << LEGACY_HASH_BITS)
+#define TRACK_BENCH_TASKS       4        // กระจายทุก core: วัดการแย่ง lock จริง ไม่ใช่ task เดียว
+
+typedef struct {
+    memory_allocation_t allocations[LEGACY_MAX_ALLOCATIONS];
+    uint16_t alloc_index[LEGACY_HASH_SIZE];
+    uint16_t free_slots[LEGACY_MAX_ALLOCATIONS];
+    int free_slot_top;
+    alloc_site_t sites[MAX_ALLOC_SITES];
+    int site_count;
+    uint8_t site_index[ALLOC_SITE_HASH_SIZE];
+    memory_stats_t stats;
+} legacy_tracker_t;
+
+static legacy_tracker_t* legacy;
+
+static inline uint32_t legacy_hash(const void* ptr) {
+    return ((uint32_t)((uintptr_t)ptr >> 3) * 2654435761u) >> (32 - LEGACY_HASH_BITS);
+}
+
+static bool legacy_tracker_init(void) {
+    legacy = heap_caps_calloc(1, sizeof(legacy_tracker_t), MALLOC_CAP_INTERNAL);
+    if (!legacy) return false;
+    for (int i = 0; i < LEGACY_MAX_ALLOCATIONS; i++) {
+        legacy->free_slots[i] = (uint16_t)(LEGACY_MAX_ALLOCATIONS - 1 - i);
+    }
+    legacy->free_slot_top = LEGACY_MAX_ALLOCATIONS;
+    legacy->sites[0].label = "other";
+    legacy->site_count = 1;
+    return true;
+}
+
+static int legacy_site_lookup(uintptr_t pc, const char* label) {
+    uint32_t h = ((uint32_t)pc * 2654435761u) >> (32 - ALLOC_SITE_HASH_BITS);
+    for (uint32_t probe = 0; probe < ALLOC_SITE_HASH_SIZE; probe++) {
+        uint32_t b = (h + probe) & (ALLOC_SITE_HASH_SIZE - 1);
+        uint8_t v = legacy->site_index[b];
+        if (v && legacy->sites[v - 1].pc == pc) return v - 1;
+        if (!v) {
+            if (legacy->site_count >= MAX_ALLOC_SITES) return 0;
+            int site = legacy->site_count++;
+            legacy->sites[site].pc = pc;
+            legacy->sites[site].label = label;
+            legacy->site_index[b] = (uint8_t)(site + 1);
+            return site;
+        }
+    }
+    return 0;
+}
+
+static int legacy_find_by_ptr(void* ptr) {
+    uint32_t h = legacy_hash(ptr);
+    for (uint32_t probe = 0; probe < LEGACY_HASH_SIZE; probe++) {
+        uint16_t v = legacy->alloc_index[(h + probe) & (LEGACY_HASH_SIZE - 1)];
+        if (v == 0) return -1;
+        if (legacy->allocations[v - 1].ptr == ptr) return v - 1;
+    }
+    return -1;
+}
+
+static void legacy_index_insert(void* ptr, int slot) {
+    uint32_t h = legacy_hash(ptr);
+    uint32_t probe = 0;
+    while (legacy->alloc_index[(h + probe) & (LEGACY_HASH_SIZE - 1)]) probe++;
+    legacy->alloc_index[(h + probe) & (LEGACY_HASH_SIZE - 1)] = (uint16_t)(slot + 1);
+    if (probe > legacy->stats.max_probe) legacy->stats.max_probe = probe;
+}
+
+static void legacy_release_slot(int slot) {
+    uint16_t* index = legacy->alloc_index;
+    uint32_t i = legacy_hash(legacy->allocations[slot].ptr);
+    while (index[i] != slot + 1) i = (i + 1) & (LEGACY_HASH_SIZE - 1);
+    for (;;) {
+        uint32_t j = i;
+        for (;;) {
+            j = (j + 1) & (LEGACY_HASH_SIZE - 1);
+            if (index[j] == 0) {
+                index[i] = 0;
+                legacy->allocations[slot].is_active = false;
+                legacy->free_slots[legacy->free_slot_top++] = (uint16_t)slot;
+                return;
+            }
+            uint32_t home = legacy_hash(legacy->allocations[index[j] - 1].ptr);
+            if (((j - home) & (LEGACY_HASH_SIZE - 1)) >= ((j - i) & (LEGACY_HASH_SIZE - 1))) break;
+        }
+        index[i] = index[j];
+        i = j;
+    }
+}
+
+__attribute__((noinline))
+static void* legacy_tracked_malloc(size_t size, uint32_t caps, const char* description) {
+    uintptr_t call_pc = (uintptr_t)esp_cpu_get_call_addr((intptr_t)__builtin_return_address(0));
+    void* ptr = heap_caps_malloc(size, caps);
+
+    if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (ptr) {
+            int slot = legacy->free_slot_top > 0 ? legacy->free_slots[--legacy->free_slot_top] : -1;
+            if (slot >= 0) {
+                memory_allocation_t* a = &legacy->allocations[slot];
+                a->ptr = ptr;
+                a->size = size;
+                a->caps = caps;
+                a->description = description;
+                a->timestamp = esp_timer_get_time();
+                a->is_active = true;
+                legacy_index_insert(ptr, slot);
+
+                int site = legacy_site_lookup(call_pc, description);
+                a->site = (uint8_t)site;
+                legacy->sites[site].live_bytes += size;
+                legacy->sites[site].live_count++;
+                legacy->sites[site].alloc_count++;
+
+                legacy->stats.total_allocations++;
+                legacy->stats.current_allocations++;
+                legacy->stats.total_bytes_allocated += size;
+                size_t current_usage = legacy->stats.total_bytes_allocated - legacy->stats.total_bytes_deallocated;
+                if (current_usage > legacy->stats.peak_usage) legacy->stats.peak_usage = current_usage;
+
+                ESP_LOGI(TAG, "✅ Allocated %d bytes at %p (%s) - Slot %d", size, ptr, description, slot);
+            } else {
+                legacy->stats.untracked_allocations++;
+                ESP_LOGW(TAG, "⚠️ Allocation tracking full (%d live) - %p (%s) untracked",
+                         LEGACY_MAX_ALLOCATIONS, ptr, description);
+            }
+        } else {
+            legacy->stats.allocation_failures++;
+            ESP_LOGE(TAG, "❌ Failed to allocate %d bytes (%s)", size, description);
+        }
+        xSemaphoreGive(memory_mutex);
+    }
+    return ptr;
+}
+
+static void legacy_tracked_free(void* ptr, const char* description) {
+    if (!ptr) return;
+    if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        int slot = legacy_find_by_ptr(ptr);
+        if (slot >= 0) {
+            memory_allocation_t* a = &legacy->allocations[slot];
+            legacy_release_slot(slot);
+            legacy->stats.total_deallocations++;
+            legacy->stats.current_allocations--;
+            legacy->stats.total_bytes_deallocated += a->size;
+            alloc_site_t* site = &legacy->sites[a->site];
+            site->live_bytes -= a->size;
+            site->live_count--;
+            site->free_count++;
+            ESP_LOGI(TAG, "🗑️ Freed %d bytes at %p (%s) - Slot %d", a->size, ptr, description, slot);
+        } else {
+            ESP_LOGW(TAG, "⚠️ Freeing untracked pointer %p (%s)", ptr, description);
+        }
+        xSemaphoreGive(memory_mutex);
+    }
+    heap_caps_free(ptr);
+}
+
+typedef enum {
+    TRACK_BENCH_UNTRACKED,
+    TRACK_BENCH_SHARDED,
+    TRACK_BENCH_LEGACY,
+    TRACK_BENCH_MODES
+} track_bench_mode_t;
+
+typedef struct {
+    track_bench_mode_t mode;
+    SemaphoreHandle_t done;
+} track_bench_arg_t;
+
+static void track_bench_worker(void *pvParameters) {
+    track_bench_arg_t* arg = (track_bench_arg_t*)pvParameters;
+    for (int i = 0; i < TRACK_BENCH_OPS; i++) {
+        void* p;
+        switch (arg->mode) {
+        case TRACK_BENCH_UNTRACKED:
+            p = heap_caps_malloc(64, MALLOC_CAP_DEFAULT);
+            heap_caps_free(p);
+            break;
+        case TRACK_BENCH_SHARDED:
+            p = tracked_malloc(64, MALLOC_CAP_DEFAULT, "Bench");
+            tracked_free(p, "Bench");
+            break;
+        default:
+            p = legacy_tracked_malloc(64, MALLOC_CAP_DEFAULT, "BenchLegacy");
+            legacy_tracked_free(p, "BenchLegacy");
+            break;
+        }
+    }
+    xSemaphoreGive(arg->done);
+    vTaskDelete(NULL);
+}
+
+// overhead ของการ track ต่อคู่ malloc+free 64B จาก TRACK_BENCH_TASKS task ที่ pin กระจายทุก core:
+// ไม่ track / shard ต่อ task (ปัจจุบัน) / tracker เดิม (mutex กลาง + log ใน lock)
+void tracking_overhead_benchmark(void) {
+    static const char* names[TRACK_BENCH_MODES] = { "untracked", "per-task shard", "global mutex + inline log" };
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(TRACK_BENCH_TASKS, 0);
+    if (!done || !legacy_tracker_init()) {
+        ESP_LOGW(TAG, "tracking benchmark skipped: out of memory");
+        if (done) vSemaphoreDelete(done);
+        return;
+    }
+
+    const int total_ops = TRACK_BENCH_OPS * TRACK_BENCH_TASKS;
+    int64_t wall_us[TRACK_BENCH_MODES];
+    track_bench_arg_t args[TRACK_BENCH_MODES];
+    for (int mode = 0; mode < TRACK_BENCH_MODES; mode++) {
+        args[mode] = (track_bench_arg_t){ (track_bench_mode_t)mode, done };
+        int64_t t0 = esp_timer_get_time();
+        for (int t = 0; t < TRACK_BENCH_TASKS; t++) {
+            xTaskCreatePinnedToCore(track_bench_worker, "TrackBench", 3072, &args[mode], 5, NULL,
+                                    t % portNUM_PROCESSORS);
+        }
+        for (int t = 0; t < TRACK_BENCH_TASKS; t++) xSemaphoreTake(done, portMAX_DELAY);
+        wall_us[mode] = esp_timer_get_time() - t0;
+    }
+    tracking_flush_logs();   // ring ของ worker ที่จบไปแล้ว: พิมพ์ทิ้งก่อนเริ่มงานจริง
+
+    ESP_LOGI(TAG, "⏱️ Tracking overhead (malloc+free 64B, %d tasks × %d ops on %d cores):",
+             TRACK_BENCH_TASKS, TRACK_BENCH_OPS, portNUM_PROCESSORS);
+    for (int mode = 0; mode < TRACK_BENCH_MODES; mode++) {
+        ESP_LOGI(TAG, "  %-26s %8.2f us/op wall (+%.2f vs untracked)", names[mode],
+                 (double)wall_us[mode] / total_ops,
+                 (double)(wall_us[mode] - wall_us[TRACK_BENCH_UNTRACKED]) / total_ops);
+    }
+
+    heap_caps_free(legacy);
+    legacy = NULL;
+    vSemaphoreDelete(done);
+}
+
 // ================= Tasks =================
 
 void memory_stress_test_task(void *pvParameters) {
@@ -196,8 +936,12 @@ void memory_stress_test_task(void *pvParameters) {
         
         if (action == 0 && allocation_count < 20) {
             size_t size = 100 + (esp_random() % 2000);
-            uint32_t caps = (esp_random() % 2) ? MALLOC_CAP_INTERNAL : MALLOC_CAP_DEFAULT;
-            test_ptrs[allocation_count] = tracked_malloc(size, caps, "StressTest");
+            // สอง call site แยกกัน เพื่อให้ตาราง call site เห็นว่าใครถือหน่วยความจำเท่าไร
+            if (esp_random() % 2) {
+                test_ptrs[allocation_count] = tracked_malloc(size, MALLOC_CAP_INTERNAL, "StressInternal");
+            } else {
+                test_ptrs[allocation_count] = tracked_malloc(size, MALLOC_CAP_DEFAULT, "StressDefault");
+            }
             if (test_ptrs[allocation_count]) {
                 memset(test_ptrs[allocation_count], 0xAA, size);
                 allocation_count++;
@@ -222,6 +966,21 @@ void memory_monitor_task(void *pvParameters) {
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(10000));
         analyze_memory_status();
+
+        // merge shard ของทุก task ตอนนี้เท่านั้น (lazy) แล้วค่อยพิมพ์ log ที่ค้างไว้
+        memory_stats_t merged;
+        alloc_site_t sites[MAX_ALLOC_SITES];
+        int site_count;
+        tracking_flush_logs();
+        tracking_merge(&merged, sites, &site_count);
+        ESP_LOGI(TAG, "📒 Tracker: %lu live (%llu B, peak %llu B) | allocs %lu frees %lu fail %lu | untracked %lu (frees %lu) | cross-task frees %lu | max probe %lu",
+                 merged.current_allocations,
+                 merged.total_bytes_allocated - merged.total_bytes_deallocated, merged.peak_usage,
+                 merged.total_allocations, merged.total_deallocations, merged.allocation_failures,
+                 merged.untracked_allocations, merged.untracked_frees, merged.cross_task_frees,
+                 merged.max_probe);
+        print_tracking_shards();
+        print_allocation_sites(sites, site_count);
         ESP_LOGI(TAG, "Free heap: %d bytes", esp_get_free_heap_size());
     }
 }
@@ -244,9 +1003,10 @@ void app_main(void) {
     gpio_set_level(LED_SPIRAM_ACTIVE, 0);
     
     memory_mutex = xSemaphoreCreateMutex();
-    memset(allocations, 0, sizeof(allocations));
+    alloc_table_init();
     
     analyze_memory_status();
+    tracking_overhead_benchmark();
     
     xTaskCreate(memory_stress_test_task, "StressTest", 4096, NULL, 5, NULL);
     xTaskCreate(memory_monitor_task, "Monitor", 4096, NULL, 4, NULL);
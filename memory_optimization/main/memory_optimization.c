@@ -14,6 +14,7 @@
 #include "esp_attr.h"
 #include "driver/gpio.h"
 #include "soc/soc_memory_layout.h"
+#include "indicator.h"
 
 static const char *TAG = "MEM_OPT";
 
@@ -111,9 +112,7 @@ void* aligned_malloc(size_t size, size_t alignment) {
     void** ptr_store = (void**)aligned_addr - 1;
     *ptr_store = raw;
     opt_stats.alignment_optimizations++;
-    gpio_set_level(LED_ALIGNMENT_OPT, 1);
-    vTaskDelay(pdMS_TO_TICKS(50));
-    gpio_set_level(LED_ALIGNMENT_OPT, 0);
+    indicator_pulse(LED_ALIGNMENT_OPT, 50);
     return (void*)aligned_addr;
 }
 
@@ -188,6 +187,7 @@ void app_main(void) {
     gpio_set_direction(LED_PACKING_OPT, GPIO_MODE_OUTPUT);
     gpio_set_direction(LED_MEMORY_SAVING, GPIO_MODE_OUTPUT);
     gpio_set_direction(LED_OPTIMIZATION, GPIO_MODE_OUTPUT);
+    indicator_init(INDICATOR_TASK_PRIORITY);
 
     static_buffer_mutex = xSemaphoreCreateMutex();
     if (!static_buffer_mutex) {
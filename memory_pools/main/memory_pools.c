@@ -6,12 +6,20 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_system.h"
 #include "esp_random.h"   // <-- IMPORTANT with IDF v5.x
+#include "esp_cpu.h"
+#include "esp_attr.h"
 #include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "memory_pools.h"
+#include "indicator.h"
 
 static const char *TAG = "MEM_POOLS";
 
@@ -36,6 +44,124 @@ static const char *TAG = "MEM_POOLS";
 #define HUGE_POOL_BLOCK_SIZE     4096
 #define HUGE_POOL_BLOCK_COUNT    2     // จะเพิ่มอัตโนมัติถ้ามี PSRAMเยอะ
 
+/* บัฟเฟอร์ DMA: internal RAM ที่ DMA เข้าถึงได้, ขึ้นต้นตรง cache line/burst ของ DMA */
+#define DMA_POOL_BLOCK_SIZE      512
+#define DMA_POOL_BLOCK_COUNT     4
+
+/* alignment ของ pointer ที่ผู้ใช้ได้ (ต้องเป็นกำลังสอง, 0 = POOL_DEFAULT_ALIGNMENT) */
+#define POOL_DEFAULT_ALIGNMENT   4
+#define HUGE_POOL_ALIGNMENT      32    // PSRAM cache line
+#define DMA_POOL_ALIGNMENT       32
+
+/* เพดานที่พูลโตได้ด้วย slab เพิ่ม (ก่อนจะต้องตกไป heap) */
+#define SMALL_POOL_MAX_BLOCKS    48
+#define MEDIUM_POOL_MAX_BLOCKS   24
+#define LARGE_POOL_MAX_BLOCKS    8
+#define HUGE_POOL_MAX_BLOCKS     4
+#define DMA_POOL_MAX_BLOCKS      8
+
+/* ---------------- Elastic slabs ----------------
+   พูลหมด -> ขอ slab ใหม่จาก heap ทีละก้อน (ครึ่งหนึ่งของขนาดตอนบูต) จนถึงเพดานข้างบน;
+   slab ที่ว่างทั้งก้อนนานเกิน POOL_SLAB_IDLE_US จะถูกคืน heap จาก pool_monitor_task */
+#define POOL_MAX_GROW_SLABS      4
+#define POOL_SLAB_IDLE_US        (10 * 1000 * 1000)
+
+/* ---------------- Lazy carving ----------------
+   1: init ไม่เดินทุกบล็อก — บล็อกที่ยังไม่เคยใช้ถูกแจกจาก bump index (carve_next) และเขียน header
+   ตอนแจกครั้งแรก, free list มีแค่บล็อกที่คืนมาแล้ว; 0: carve ทั้งพูลตอนบูตแบบเดิม (ไว้เทียบเวลาบูต) */
+#define POOL_LAZY_CARVE          1
+
+/* ---------------- Build policy ----------------
+   เลือกตอนคอมไพล์ (-DPOOL_POLICY=...):
+   RELEASE: ไม่มี magic/bounds check, ไม่มี timestamp/latency histogram, ไม่อัปเดต bitmap บน fast path
+            (bitmap ถูกสร้างใหม่จาก free list ตอนสลับ strategy เท่านั้น)
+   DEFAULT: พฤติกรรมเดิมของ lab
+   DEBUG:   DEFAULT + poison ข้อมูลตอน free (ตรวจตอน alloc = จับ use-after-free) + canary ท้ายบล็อก */
+#define POOL_POLICY_RELEASE      0
+#define POOL_POLICY_DEFAULT      1
+#define POOL_POLICY_DEBUG        2
+#ifndef POOL_POLICY
+#define POOL_POLICY              POOL_POLICY_DEFAULT
+#endif
+
+#define POOL_CHECKS              (POOL_POLICY >= POOL_POLICY_DEFAULT)
+#define POOL_TIMING              (POOL_POLICY >= POOL_POLICY_DEFAULT)
+#define POOL_TRACK_BITMAP        (POOL_POLICY >= POOL_POLICY_DEFAULT)
+#define POOL_POISON              (POOL_POLICY >= POOL_POLICY_DEBUG)
+#define POOL_CANARY_BYTES        ((POOL_POLICY >= POOL_POLICY_DEBUG) ? 4 : 0)
+#define POOL_POISON_BYTE         0xA5
+#define POOL_CANARY_VALUE        0xC0FFEE11u
+#define POOL_POLICY_NAME \
+    (POOL_POLICY == POOL_POLICY_RELEASE ? "release" : POOL_POLICY == POOL_POLICY_DEBUG ? "debug" : "default")
+
+/* POOL_VERIFY(cond): จริงถ้า cond เป็นจริง หรือ policy นี้ไม่ตรวจ (คอมไพเลอร์ตัดทิ้งทั้งนิพจน์) */
+#define POOL_VERIFY(cond)        (!POOL_CHECKS || (cond))
+#if POOL_TIMING
+#define POOL_TIME_NOW()          esp_timer_get_time()
+#define POOL_CYCLES()            esp_cpu_get_cycle_count()
+#define POOL_LATENCY(h, c0)      pool_latency_record((h), esp_cpu_get_cycle_count() - (c0))
+#else
+#define POOL_TIME_NOW()          0
+#define POOL_CYCLES()            0
+#define POOL_LATENCY(h, c0)      ((void)(c0))
+#endif
+
+/* ---------------- Allocation strategy ----------------
+   FREELIST: LIFO linked list (เขียน next ลงในบล็อกที่ว่าง)
+   BITMAP:   หา bit ว่างต่ำสุดใน usage_bitmap ด้วย __builtin_ctz ทีละ word 32 บิต
+             -> ได้บล็อก address ต่ำสุดเสมอ และไม่แตะหน่วยความจำของบล็อกตอน alloc/free
+   LOCKFREE: Treiber stack ของ block index, head = [tag:16][index+1:16] อัปเดตด้วย
+             esp_cpu_compare_and_set (S32C1I) -> ไม่ใช้ mutex/spinlock/magazine, ไม่มีวัน block;
+             next เก็บใน side array (lf_next) จึงไม่อ่านหน่วยความจำของบล็อกที่อาจถูกใช้ไปแล้ว,
+             tag เพิ่มทุกครั้งที่ CAS สำเร็จกัน ABA; โหมดนี้ไม่โตด้วย slab */
+typedef enum {
+    POOL_STRATEGY_FREELIST = 0,
+    POOL_STRATEGY_BITMAP,
+    POOL_STRATEGY_LOCKFREE,
+} pool_strategy_t;
+
+#define POOL_DEFAULT_STRATEGY    POOL_STRATEGY_FREELIST
+
+/* ---------------- Generation-tagged handles ----------------
+   handle 32 บิต = [pool_id:4][generation:12][block index:16]
+   generation ของบล็อกเพิ่มทุกครั้งที่ถูก free -> handle เก่าใช้ไม่ได้อีก ตรวจได้ O(1) จาก side array
+   โดยไม่ต้องอ่านตัวบล็อก; pool_id เริ่มที่ 1 จึงไม่มี handle ที่ถูกต้องเป็น 0 */
+typedef uint32_t pool_handle_t;
+
+#define POOL_HANDLE_INVALID      0u
+#define POOL_HANDLE_INDEX_BITS   16
+#define POOL_HANDLE_GEN_BITS     12
+#define POOL_HANDLE_GEN_MASK     ((1u << POOL_HANDLE_GEN_BITS) - 1)
+#define POOL_HANDLE_MAKE(pid, gen, idx) \
+    (((uint32_t)(pid) << (POOL_HANDLE_INDEX_BITS + POOL_HANDLE_GEN_BITS)) | \
+     (((uint32_t)(gen) & POOL_HANDLE_GEN_MASK) << POOL_HANDLE_INDEX_BITS) | (uint32_t)(idx))
+#define POOL_HANDLE_POOL_ID(h)   ((h) >> (POOL_HANDLE_INDEX_BITS + POOL_HANDLE_GEN_BITS))
+#define POOL_HANDLE_GEN(h)       (((h) >> POOL_HANDLE_INDEX_BITS) & POOL_HANDLE_GEN_MASK)
+#define POOL_HANDLE_INDEX(h)     ((h) & ((1u << POOL_HANDLE_INDEX_BITS) - 1))
+
+/* ---------------- Per-core magazine cache ----------------
+   แต่ละ core ถือ block ว่างของแต่ละพูลไว้เองเล็กน้อย: alloc/free ปกติใช้แค่ spinlock
+   ของ core ตัวเอง, mutex ของพูลใช้เฉพาะตอนเติม/คืนเป็นชุด (slow path) */
+#define POOL_MAGAZINE_SIZE       8     // blocks cached per core per pool
+#define POOL_MAGAZINE_BATCH      4     // blocks moved per refill/flush
+
+/* ---------------- Remote-free lists ----------------
+   เจ้าของ block = core ที่จองมันออกจาก magazine; free จาก core อื่นไม่แตะ magazine/mutex ของเจ้าของ
+   แต่ push ลง singly-linked list แบบ atomic ของ core เจ้าของ แล้วเจ้าของดึงทั้ง list คืนด้วย swap
+   ครั้งเดียวตอน magazine ว่างครั้งถัดไป (push อย่างเดียว + swap ทั้งก้อน จึงไม่มีปัญหา ABA)
+   ค่านี้เป็นค่าเริ่มต้นของทุกพูล; ปิดรายพูลได้ด้วย pool->no_remote_free */
+#define POOL_REMOTE_FREE_ENABLED 1
+
+/* ---------------- Latency histograms ----------------
+   ฮิสโตแกรม log2 ของ CPU cycles ต่อการเรียกหนึ่งครั้ง: bucket b = [2^b, 2^(b+1)) cycles
+   แยก alloc/free ออกจากเวลารอ mutex เพื่อดูว่า tail มาจากการแย่ง lock หรือจากตัว free list */
+#define POOL_LAT_BUCKETS         24    // 2^24 cycles ≈ 100 ms @160MHz, เกินนี้นับรวมช่องสุดท้าย
+
+typedef struct {
+    uint32_t buckets[POOL_LAT_BUCKETS];
+    uint32_t max_cycles;
+} pool_latency_hist_t;
+
 /* ---------------- Internal structures ---------------- */
 typedef struct memory_block {
     struct memory_block* next;
@@ -44,6 +170,34 @@ typedef struct memory_block {
     uint64_t alloc_time;
 } memory_block_t;
 
+/* metadata แยกนอกบล็อก (external_meta): เก็บใน side array ตาม index เดียวกับ usage_bitmap
+   ตัวบล็อกจึงเรียงติดกันแน่น; ตอนว่าง 4 ไบต์แรกของบล็อกใช้เป็น next ของ free list */
+typedef struct {
+    uint32_t magic;
+    uint64_t alloc_time;
+} block_meta_t;
+
+typedef struct {
+    uint8_t* memory;         // NULL = slot unused
+    memory_block_t* free_list;   // this slab's free blocks (FREELIST); pool->free_list holds base blocks only
+    size_t used;             // blocks out of the central free list
+    int64_t idle_since;      // time used dropped to 0, 0 = busy, -1 = idle but not stamped yet
+} pool_slab_t;
+
+typedef struct {
+    memory_block_t* blocks[POOL_MAGAZINE_SIZE];
+    uint32_t count;
+    uint32_t allocs;         // served from this magazine
+    uint32_t frees;          // returned into this magazine
+    uint32_t refills;
+    uint32_t flushes;
+    portMUX_TYPE lock;
+    memory_block_t* remote_head;     // frees from other cores, linked through blk->next
+    uint32_t remote_count;
+    uint32_t remote_frees;           // pushed by other cores
+    uint32_t remote_reclaims;        // swaps that refilled this magazine
+} pool_magazine_t;
+
 typedef struct {
     const char* name;
     size_t block_size;
@@ -52,19 +206,53 @@ typedef struct {
     uint32_t caps;
 
     void* pool_memory;
-    memory_block_t* free_list;
-    uint8_t* usage_bitmap;   // 1 bit per block
+    memory_block_t* free_list;   // base blocks; each growth slab keeps its own list in slabs[k]
+    uint32_t* usage_bitmap;  // 1 bit per block, 1 = used or not present
+    size_t bitmap_words;
+    pool_strategy_t strategy;
+    volatile uint32_t lf_head;   // LOCKFREE: [tag:16][index+1:16], 0 index = empty
+    uint16_t* lf_next;           // LOCKFREE: index+1 of next free block
+    bool no_magazines;           // bypass the per-core cache for this pool
+    bool no_remote_free;         // cross-core frees land in the freeing core's magazine, not the owner's remote list
+    bool external_meta;
+    block_meta_t* meta;      // side array, external_meta only
+    uint16_t* generations;   // per block index, bumped on every free
+    uint8_t* owners;         // per block index: core+1 that took it from its magazine, 0 = not from a magazine
 
+    size_t base_block_count; // blocks in pool_memory (never released)
+    size_t carve_next;       // base blocks [carve_next..) never handed out, header not written
+    size_t slab_blocks;      // blocks per growth slab
+    size_t max_slabs;
+    pool_slab_t slabs[POOL_MAX_GROW_SLABS];
+    uint32_t slab_grows;
+    uint32_t slab_shrinks;
+
+    volatile uint32_t stats_seq;     // seqlock over allocated/peak/block_count/slab counters (odd = writing)
     size_t allocated_blocks;
     size_t peak_usage;
-    uint64_t total_allocations;
+    uint64_t total_allocations;      // updated with __atomic_* so readers never need the mutex
     uint64_t total_deallocations;
     uint64_t allocation_time_total;
     uint64_t deallocation_time_total;
     uint32_t allocation_failures;
+    volatile bool quiet_exhaustion;   // benchmark run: นับ warning "pool exhausted" แทนการพิมพ์ทีละครั้ง
+    uint32_t quiet_exhaustion_count;
+    pool_latency_hist_t alloc_latency;
+    pool_latency_hist_t free_latency;
+    pool_latency_hist_t mutex_wait;   // xSemaphoreTake บนเส้นทาง alloc/free เท่านั้น
+    uint32_t mutex_acquisitions;      // same call sites as mutex_wait
 
     SemaphoreHandle_t mutex;
     uint32_t pool_id;
+
+    pool_magazine_t magazines[portNUM_PROCESSORS];
+
+    portMUX_TYPE lock;               // guards free_list/bitmap for ISR callers
+    uint32_t isr_allocations;
+    uint32_t isr_deallocations;
+    uint32_t isr_alloc_max_cycles;   // measured worst case, CPU cycles
+    uint32_t isr_free_max_cycles;
+    uint32_t debug_violations;       // DEBUG policy: poison/canary damage seen
 } memory_pool_t;
 
 typedef enum {
@@ -72,56 +260,381 @@ typedef enum {
     POOL_MEDIUM,
     POOL_LARGE,
     POOL_HUGE,
+    POOL_DMA,                // ไม่อยู่ในเส้นทางของ smart_pool_malloc: ใช้ผ่าน dma_pool_malloc เท่านั้น
     POOL_COUNT
 } pool_type_t;
 
+#define POOL_GENERAL_COUNT  (POOL_HUGE + 1)   // pools smart_pool_malloc may pick from
+
 typedef struct {
     const char* name;
     size_t block_size;
     size_t block_count;
+    size_t max_block_count;  // เพดานเมื่อโตด้วย slab (<= block_count = ไม่โต)
     uint32_t caps;
     gpio_num_t led_pin;
+    bool external_meta;      // header นอกบล็อก: block นับได้มากขึ้นในงบ heap เท่าเดิม
+    size_t alignment;        // user pointer alignment, 0 = POOL_DEFAULT_ALIGNMENT
 } pool_config_t;
 
+/* ---------------- Size classes (compile time) ----------------
+   คลาสขนาดแบบ geometric: 4 คลาสต่อการเพิ่มขึ้นสองเท่า (ห่างกัน 12.5–25%) ตั้งแต่ 16B ถึง 4KB
+   คลาส i มีขนาด (4 + i%4) << (i/4 + 2) และถูกจับคู่กับพูลเล็กที่สุดที่ใส่ได้ตั้งแต่ตอนคอมไพล์
+   คลาสเป็นแค่ตัว lookup/บัญชี: ทุกคลาสยังจองจาก 4 พูลจริง ไม่มีพูลแยกต่อคลาส
+   (ตัวเลขที่ใช้คลาสจึงเป็น projection ให้ pool_profile_derive เลือก geometry ใหม่) */
+#define SMART_POOL_HEADROOM      16
+#define SIZE_CLASS_MIN_SHIFT     4     // 16 B
+#define SIZE_CLASS_MAX_SHIFT     12    // 4 KB
+#define SIZE_CLASS_COUNT         ((SIZE_CLASS_MAX_SHIFT - SIZE_CLASS_MIN_SHIFT) * 4 + 1)
+#define SIZE_CLASS_BYTES(i)      ((4u + ((i) & 3u)) << (((i) >> 2) + SIZE_CLASS_MIN_SHIFT - 2))
+#define SIZE_CLASS_POOL(i) \
+    (SIZE_CLASS_BYTES(i) <= SMALL_POOL_BLOCK_SIZE  ? POOL_SMALL  : \
+     SIZE_CLASS_BYTES(i) <= MEDIUM_POOL_BLOCK_SIZE ? POOL_MEDIUM : \
+     SIZE_CLASS_BYTES(i) <= LARGE_POOL_BLOCK_SIZE  ? POOL_LARGE  : POOL_HUGE)
+
+typedef struct {
+    uint16_t bytes;
+    uint8_t  pool;           // pool_type_t
+} size_class_t;
+
+#define SC_ENTRY(i)  { SIZE_CLASS_BYTES(i), SIZE_CLASS_POOL(i) }
+#define SC_ROW(r)    SC_ENTRY(4*(r)), SC_ENTRY(4*(r)+1), SC_ENTRY(4*(r)+2), SC_ENTRY(4*(r)+3)
+
+static const size_class_t size_classes[SIZE_CLASS_COUNT] = {
+    SC_ROW(0), SC_ROW(1), SC_ROW(2), SC_ROW(3),
+    SC_ROW(4), SC_ROW(5), SC_ROW(6), SC_ROW(7),
+    SC_ENTRY(32)
+};
+_Static_assert(SIZE_CLASS_BYTES(SIZE_CLASS_COUNT - 1) == HUGE_POOL_BLOCK_SIZE,
+               "size-class table must end at the Huge pool block size");
+
+/* O(1): ใช้ CLZ หาเลขยกกำลังสอง แล้ว 2 บิตถัดไปเป็นคลาสย่อย; -1 = ใหญ่เกินทุกคลาส */
+static inline int size_class_index(size_t size)
+{
+    if (size <= (1u << SIZE_CLASS_MIN_SHIFT)) return 0;
+    if (size > SIZE_CLASS_BYTES(SIZE_CLASS_COUNT - 1)) return -1;
+    uint32_t m = (uint32_t)size - 1;
+    int p = 31 - __builtin_clz(m);
+    int k = (int)((m >> (p - 2)) & 3u);
+    return (p - SIZE_CLASS_MIN_SHIFT) * 4 + k + 1;
+}
+
 /* ---------------- Magic for corruption checks ---------------- */
 #define POOL_MAGIC_FREE   0xDEADBEEF
 #define POOL_MAGIC_ALLOC  0xCAFEBABE
+#define POOL_MAGIC_FREEING 0xFEEDF00D   // claimed by one free path, not yet back on a free list
 
 /* ---------------- Globals ---------------- */
 static memory_pool_t pools[POOL_COUNT] = {0};
 
-/* ---------------- Helpers ---------------- */
-static inline size_t aligned_size(size_t size, size_t align) {
+/* สถิติ internal fragmentation ของ smart_pool_malloc: layout 4 พูลจริง (วัดได้)
+   เทียบกับ what-if ถ้ามีพูลแยกตามคลาส geometric (คำนวณเอา ไม่มีพูลแบบนั้นจริง) */
+static struct {
+    uint32_t requests;
+    uint64_t requested_bytes;
+    uint64_t pool_block_bytes;   // block ที่ได้จริงจาก 4 พูล
+    uint64_t class_bytes;        // projection: ขนาดคลาสของคำขอ ถ้าแต่ละคลาสมีพูลของตัวเอง
+} size_class_stats;
+
+/* ---------------- Address-range index ----------------
+   ช่วง address ของทุก region (base + growth slab) ของทุกพูล เรียงตาม start
+   ฝั่งอ่านไม่ล็อก (seqlock): pointer -> พูลเจ้าของ หรือ NULL = heap fallback;
+   ฝั่งเขียน (init/grow/shrink) ถือ pool_index_lock */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;           // exclusive
+    memory_pool_t* pool;
+} pool_range_t;
+
+static pool_range_t pool_index[POOL_COUNT * (1 + POOL_MAX_GROW_SLABS)];
+static size_t pool_index_count = 0;
+static volatile uint32_t pool_index_seq = 0;
+static portMUX_TYPE pool_index_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ---------------- Helpers ----------------
+   ตัวที่ ISR path เรียกถึงติด IRAM_ATTR: ถ้า compiler ไม่ inline ก็ยังไม่วิ่งจาก flash ตอน cache ปิด */
+static inline size_t IRAM_ATTR aligned_size(size_t size, size_t align) {
     return (size + align - 1) & ~(align - 1);
 }
 
+/* header ปัดขึ้นเป็นพหุคูณของ alignment: base กับ stride ตรง alignment แล้ว user pointer จึงตรงด้วย */
+static inline size_t IRAM_ATTR pool_header_size(const memory_pool_t* pool) {
+    return pool->external_meta ? 0 : aligned_size(sizeof(memory_block_t), pool->alignment);
+}
+
+static inline size_t IRAM_ATTR pool_stride(const memory_pool_t* pool) {
+    return pool_header_size(pool) + aligned_size(pool->block_size + POOL_CANARY_BYTES, pool->alignment);
+}
+
+#define POOL_SLAB_BASE  (-1)
+#define POOL_SLAB_NONE  (-2)
+#define POOL_SLAB_IDLE_UNSTAMPED  (-1)   // idle_since: free path เห็นว่าว่างแล้ว รอ reclaim ประทับเวลา
+
+/* หา region ของ blk: POOL_SLAB_BASE = pool_memory, 0.. = growth slab, POOL_SLAB_NONE = ไม่ใช่ของพูลนี้
+   index ที่ได้ใช้ร่วมกับ usage_bitmap/meta: base ก่อน แล้วตามด้วย slab ตามลำดับช่อง */
+static inline int IRAM_ATTR pool_locate(const memory_pool_t* pool, const memory_block_t* blk, size_t* index)
+{
+    const size_t stride = pool_stride(pool);
+    const uint8_t* b = (const uint8_t*)blk;
+    const uint8_t* m = (const uint8_t*)pool->pool_memory;
+
+    if (m && b >= m && b < m + stride * pool->base_block_count) {
+        if ((size_t)(b - m) % stride) return POOL_SLAB_NONE;
+        *index = (size_t)(b - m) / stride;
+        return POOL_SLAB_BASE;
+    }
+    for (int k = 0; k < (int)pool->max_slabs; k++) {
+        m = pool->slabs[k].memory;
+        if (m && b >= m && b < m + stride * pool->slab_blocks) {
+            if ((size_t)(b - m) % stride) return POOL_SLAB_NONE;
+            *index = pool->base_block_count + k * pool->slab_blocks + (size_t)(b - m) / stride;
+            return k;
+        }
+    }
+    return POOL_SLAB_NONE;
+}
+
+static inline size_t IRAM_ATTR pool_block_index(const memory_pool_t* pool, const memory_block_t* blk) {
+    size_t idx = 0;
+    pool_locate(pool, blk, &idx);
+    return idx;
+}
+
+/* กลับด้านของ pool_locate: index -> บล็อก (NULL ถ้า slab ช่องนั้นไม่มีอยู่) */
+static inline memory_block_t* IRAM_ATTR pool_block_at(const memory_pool_t* pool, size_t idx)
+{
+    const size_t stride = pool_stride(pool);
+    if (idx < pool->base_block_count) {
+        return (memory_block_t*)((uint8_t*)pool->pool_memory + idx * stride);
+    }
+    if (!pool->slab_blocks) return NULL;
+    idx -= pool->base_block_count;
+    size_t k = idx / pool->slab_blocks;
+    if (k >= pool->max_slabs || !pool->slabs[k].memory) return NULL;
+    return (memory_block_t*)(pool->slabs[k].memory + (idx % pool->slab_blocks) * stride);
+}
+
+/* free list ของ region: base ใช้ pool->free_list, growth slab มี list ของตัวเอง
+   -> คืน slab ทั้งก้อนได้โดยทิ้ง list ของมัน ไม่ต้องเดินกรองทั้งพูล */
+static inline memory_block_t** IRAM_ATTR pool_free_head(memory_pool_t* pool, int slab) {
+    return (slab >= 0) ? &pool->slabs[slab].free_list : &pool->free_list;
+}
+
+static inline int pool_index_slab(const memory_pool_t* pool, size_t idx) {
+    return (idx < pool->base_block_count) ? POOL_SLAB_BASE : (int)((idx - pool->base_block_count) / pool->slab_blocks);
+}
+
+static inline void IRAM_ATTR pool_bitmap_set(memory_pool_t* pool, size_t idx) {
+    pool->usage_bitmap[idx >> 5] |= (1u << (idx & 31));
+}
+
+static inline void IRAM_ATTR pool_bitmap_clear(memory_pool_t* pool, size_t idx) {
+    pool->usage_bitmap[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+/* bitmap บน fast path: BITMAP strategy ต้องใช้เสมอ, strategy อื่นใช้แค่ดู/สลับ จึงตัดได้ใน RELEASE */
+static inline bool IRAM_ATTR pool_tracks_bitmap(const memory_pool_t* pool) {
+    return POOL_TRACK_BITMAP || pool->strategy == POOL_STRATEGY_BITMAP;
+}
+
+/* ทีละ word: ขอบหัว/ท้ายเป็น mask บางส่วน ตรงกลางเขียนทั้ง word (ใช้ใน spinlock ตอน grow/release slab) */
+static void pool_bitmap_fill(memory_pool_t* pool, size_t first, size_t n, bool used) {
+    while (n) {
+        size_t bit = first & 31;
+        size_t take = (32 - bit < n) ? 32 - bit : n;
+        uint32_t mask = (take == 32) ? 0xFFFFFFFFu : (((1u << take) - 1) << bit);
+        if (used) pool->usage_bitmap[first >> 5] |= mask;
+        else      pool->usage_bitmap[first >> 5] &= ~mask;
+        first += take;
+        n -= take;
+    }
+}
+
+static inline void* IRAM_ATTR block_to_user(const memory_pool_t* pool, memory_block_t* blk) {
+    return (uint8_t*)blk + pool_header_size(pool);
+}
+
+static inline memory_block_t* IRAM_ATTR user_to_block(const memory_pool_t* pool, void* ptr) {
+    return (memory_block_t*)((uint8_t*)ptr - pool_header_size(pool));
+}
+
+static inline bool IRAM_ATTR pool_owns_block(const memory_pool_t* pool, const memory_block_t* blk)
+{
+    size_t idx;
+    return pool_locate(pool, blk, &idx) != POOL_SLAB_NONE;
+}
+
+/* block ต้องเป็นของพูลนี้แล้ว (external_meta ใช้ index ไปอ่าน side array) */
+static inline uint32_t IRAM_ATTR block_magic(const memory_pool_t* pool, const memory_block_t* blk) {
+    return pool->external_meta ? pool->meta[pool_block_index(pool, blk)].magic : blk->magic;
+}
+
+static inline bool IRAM_ATTR block_is(const memory_pool_t* pool, const memory_block_t* blk, uint32_t magic) {
+    if (pool->external_meta) return pool->meta[pool_block_index(pool, blk)].magic == magic;
+    return blk->magic == magic && blk->pool_id == pool->pool_id;
+}
+
+/* DEBUG policy: canary ท้ายข้อมูลผู้ใช้ และ poison ส่วนข้อมูล (เว้น word แรกที่อาจเป็น next ของ free list)
+   ไม่ log ที่นี่ (อาจอยู่ใน spinlock/ISR) — นับไว้ใน debug_violations ให้ monitor รายงาน */
+static inline void IRAM_ATTR block_debug_mark(memory_pool_t* pool, memory_block_t* blk, uint32_t magic)
+{
+#if POOL_POLICY >= POOL_POLICY_DEBUG
+    uint8_t* user = (uint8_t*)blk + pool_header_size(pool);
+    uint32_t canary = POOL_CANARY_VALUE ^ (uint32_t)(uintptr_t)blk;
+    size_t skip = sizeof(void*);
+    if (magic == POOL_MAGIC_ALLOC) {
+        for (size_t i = skip; i < pool->block_size; i++) {
+            if (user[i] != POOL_POISON_BYTE) {
+                __atomic_fetch_add(&pool->debug_violations, 1, __ATOMIC_RELAXED);   // written after free
+                break;
+            }
+        }
+        memcpy(user + pool->block_size, &canary, sizeof(canary));
+    } else {
+        uint32_t seen;
+        memcpy(&seen, user + pool->block_size, sizeof(seen));
+        if (seen != canary && block_magic(pool, blk) != POOL_MAGIC_FREE) {
+            __atomic_fetch_add(&pool->debug_violations, 1, __ATOMIC_RELAXED);       // overran the block
+        }
+        if (pool->block_size > skip) memset(user + skip, POOL_POISON_BYTE, pool->block_size - skip);
+    }
+#else
+    (void)pool; (void)blk; (void)magic;
+#endif
+}
+
+/* ALLOC -> FREE: เลื่อน generation หนึ่งครั้งต่อการ free หนึ่งครั้ง ให้ handle เก่าใช้ไม่ได้ทันที
+   เรียกจากจุด free เท่านั้น ไม่ใช่ใน block_mark เพราะ block ที่ผ่าน magazine จะถูก mark FREE ซ้ำ
+   ตอน flush/reclaim (และ compaction คืนช่องที่พักไว้) ทำให้ wrap window 12 บิตหดลง */
+static inline void IRAM_ATTR block_retire(memory_pool_t* pool, memory_block_t* blk) {
+    if (pool->generations) pool->generations[pool_block_index(pool, blk)]++;
+}
+
+/* ALLOC -> FREEING ด้วย CAS บน magic: free สองทางที่แข่งกันบนบล็อกเดียว (double free ข้าม core/ISR)
+   ผ่านได้ทางเดียว อีกทางเห็นว่าไม่ใช่ ALLOC แล้วถูกปฏิเสธก่อนแตะ free list/LF stack
+   (RELEASE ไม่เก็บ magic จึงไม่มีอะไรให้ claim — ทั้งทางถูกตัดด้วย POOL_VERIFY อยู่แล้ว) */
+static inline bool IRAM_ATTR block_claim(memory_pool_t* pool, memory_block_t* blk)
+{
+#if POOL_CHECKS
+    if (pool->external_meta) {
+        return esp_cpu_compare_and_set((volatile uint32_t*)&pool->meta[pool_block_index(pool, blk)].magic,
+                                       POOL_MAGIC_ALLOC, POOL_MAGIC_FREEING);
+    }
+    if (blk->pool_id != pool->pool_id) return false;
+    return esp_cpu_compare_and_set((volatile uint32_t*)&blk->magic, POOL_MAGIC_ALLOC, POOL_MAGIC_FREEING);
+#else
+    (void)pool; (void)blk;
+    return true;
+#endif
+}
+
+static inline void IRAM_ATTR block_mark(memory_pool_t* pool, memory_block_t* blk, uint32_t magic, uint64_t t) {
+    block_debug_mark(pool, blk, magic);
+    if (!POOL_CHECKS && !POOL_TIMING) return;
+    if (pool->external_meta) {
+        block_meta_t* m = &pool->meta[pool_block_index(pool, blk)];
+        m->magic = magic;
+        if (t) m->alloc_time = t;
+    } else {
+        blk->magic = magic;
+        if (t) blk->alloc_time = t;
+    }
+}
+
+static inline void pool_block_init(memory_pool_t* pool, memory_block_t* blk, size_t idx)
+{
+    if (POOL_POISON) {
+        memset((uint8_t*)blk + pool_header_size(pool), POOL_POISON_BYTE, pool->block_size);
+    }
+    if (pool->external_meta) {
+        pool->meta[idx].magic = POOL_MAGIC_FREE;
+        pool->meta[idx].alloc_time = 0;
+    } else {
+        blk->magic = POOL_MAGIC_FREE;
+        blk->pool_id = pool->pool_id;
+        blk->alloc_time = 0;
+    }
+}
+
+/* ตั้ง header/metadata ของบล็อกใหม่ n ตัวเป็น FREE แล้วร้อยเป็น list; คืน head, *tail = ตัวท้าย */
+static memory_block_t* pool_carve(memory_pool_t* pool, uint8_t* mem, size_t first_index, size_t n,
+                                  memory_block_t** tail)
+{
+    const size_t stride = pool_stride(pool);
+    memory_block_t* head = NULL;
+    *tail = NULL;
+    for (size_t i = 0; i < n; i++) {
+        memory_block_t* blk = (memory_block_t*)(mem + i * stride);
+        pool_block_init(pool, blk, first_index + i);
+        if (pool->strategy == POOL_STRATEGY_BITMAP) continue;
+        blk->next = head;
+        head = blk;
+        if (!*tail) *tail = blk;
+    }
+    return head;
+}
+
+/* lazy carving: เขียน header ของบล็อก base ที่ยังไม่เคยแจก [carve_next, end) (ถือ pool->lock อยู่) */
+static inline void pool_carve_upto(memory_pool_t* pool, size_t end)
+{
+    while (pool->carve_next < end) {
+        size_t idx = pool->carve_next++;
+        pool_block_init(pool, pool_block_at(pool, idx), idx);
+    }
+}
+
 static bool try_init_pool(memory_pool_t* pool, const pool_config_t* cfg, uint32_t pool_id, size_t block_count)
 {
     memset(pool, 0, sizeof(*pool));
     pool->name       = cfg->name;
     pool->block_size = cfg->block_size;
     pool->block_count= block_count;
-    pool->alignment  = 4;
+    pool->alignment  = cfg->alignment ? cfg->alignment : POOL_DEFAULT_ALIGNMENT;
+    if (pool->alignment & (pool->alignment - 1)) {
+        ESP_LOGW(TAG, "%s: alignment %u is not a power of two -> %u", cfg->name,
+                 (unsigned)pool->alignment, (unsigned)POOL_DEFAULT_ALIGNMENT);
+        pool->alignment = POOL_DEFAULT_ALIGNMENT;
+    }
     pool->caps       = cfg->caps;
     pool->pool_id    = pool_id;
+    pool->external_meta = cfg->external_meta;
+    pool->strategy   = POOL_DEFAULT_STRATEGY;
+    pool->no_remote_free = !POOL_REMOTE_FREE_ENABLED;
+    portMUX_INITIALIZE(&pool->lock);
+    for (int c = 0; c < portNUM_PROCESSORS; c++) portMUX_INITIALIZE(&pool->magazines[c].lock);
 
-    const size_t hdr   = sizeof(memory_block_t);
-    const size_t data  = aligned_size(pool->block_size, pool->alignment);
-    const size_t stride= hdr + data;
+    const size_t data  = aligned_size(pool->block_size + POOL_CANARY_BYTES, pool->alignment);
+    const size_t stride= pool_stride(pool);
+    if (pool->external_meta) {
+        /* งบ heap เท่ากับแบบ header ในบล็อก แต่แบ่งเป็นบล็อกแน่น ๆ ได้มากกว่า */
+        pool->block_count = (aligned_size(sizeof(memory_block_t), pool->alignment) + data) * block_count / stride;
+    }
     const size_t total = stride * pool->block_count;
 
-    ESP_LOGI(TAG, "%s: requesting pool memory %u blocks × %uB (stride %uB) = %uB (caps 0x%X)",
+    pool->base_block_count = pool->block_count;
+    if (cfg->max_block_count > block_count) {
+        pool->slab_blocks = (pool->block_count > 1) ? pool->block_count / 2 : 1;
+        size_t extra = (cfg->max_block_count - block_count) * pool->block_count / block_count;
+        pool->max_slabs = (extra + pool->slab_blocks - 1) / pool->slab_blocks;
+        if (pool->max_slabs > POOL_MAX_GROW_SLABS) pool->max_slabs = POOL_MAX_GROW_SLABS;
+    }
+    /* bitmap/meta จองเผื่อ slab ทุกช่องไว้ตั้งแต่ต้น (เล็กและอยู่ใน internal RAM) */
+    const size_t index_capacity = pool->base_block_count + pool->max_slabs * pool->slab_blocks;
+
+    ESP_LOGI(TAG, "%s: requesting pool memory %u blocks × %uB (stride %uB, align %u) = %uB (caps 0x%X)",
              pool->name, (unsigned)pool->block_count, (unsigned)pool->block_size,
-             (unsigned)stride, (unsigned)total, (unsigned)pool->caps);
+             (unsigned)stride, (unsigned)pool->alignment, (unsigned)total, (unsigned)pool->caps);
 
-    pool->pool_memory = heap_caps_malloc(total, pool->caps);
+    pool->pool_memory = heap_caps_aligned_alloc(pool->alignment, total, pool->caps);
     if (!pool->pool_memory) {
-        ESP_LOGW(TAG, "%s: heap_caps_malloc(%uB, caps=0x%X) FAILED", pool->name, (unsigned)total, (unsigned)pool->caps);
+        ESP_LOGW(TAG, "%s: heap_caps_aligned_alloc(%u, %uB, caps=0x%X) FAILED", pool->name,
+                 (unsigned)pool->alignment, (unsigned)total, (unsigned)pool->caps);
         return false;
     }
 
-    const size_t bitmap_bytes = (pool->block_count + 7) / 8;
-    pool->usage_bitmap = (uint8_t*) heap_caps_calloc(bitmap_bytes, 1, MALLOC_CAP_INTERNAL);
+    pool->bitmap_words = (index_capacity + 31) / 32;
+    const size_t bitmap_bytes = pool->bitmap_words * sizeof(uint32_t);
+    pool->usage_bitmap = (uint32_t*) heap_caps_calloc(pool->bitmap_words, sizeof(uint32_t), MALLOC_CAP_INTERNAL);
     if (!pool->usage_bitmap) {
         ESP_LOGW(TAG, "%s: bitmap alloc (%uB) FAILED", pool->name, (unsigned)bitmap_bytes);
         heap_caps_free(pool->pool_memory);
@@ -129,174 +642,1958 @@ static bool try_init_pool(memory_pool_t* pool, const pool_config_t* cfg, uint32_
         return false;
     }
 
-    pool->free_list = NULL;
-    uint8_t* p = (uint8_t*)pool->pool_memory;
-    for (size_t i = 0; i < pool->block_count; i++) {
-        memory_block_t* blk = (memory_block_t*)(p + i * stride);
-        blk->magic = POOL_MAGIC_FREE;
-        blk->pool_id = pool->pool_id;
-        blk->alloc_time = 0;
-        blk->next = pool->free_list;
-        pool->free_list = blk;
+    if (pool->external_meta) {
+        pool->meta = (block_meta_t*) heap_caps_calloc(index_capacity, sizeof(block_meta_t), MALLOC_CAP_INTERNAL);
+        if (!pool->meta) {
+            ESP_LOGW(TAG, "%s: side metadata alloc (%uB) FAILED", pool->name,
+                     (unsigned)(index_capacity * sizeof(block_meta_t)));
+            heap_caps_free(pool->usage_bitmap);
+            heap_caps_free(pool->pool_memory);
+            pool->usage_bitmap = NULL;
+            pool->pool_memory = NULL;
+            return false;
+        }
+    }
+
+    /* generation + owner ต่อ block index อยู่ใน allocation เดียวกัน */
+    pool->generations = (uint16_t*) heap_caps_calloc(index_capacity, sizeof(uint16_t) + sizeof(uint8_t),
+                                                     MALLOC_CAP_INTERNAL);
+    if (!pool->generations) {
+        ESP_LOGW(TAG, "%s: generation table alloc (%uB) FAILED", pool->name,
+                 (unsigned)(index_capacity * (sizeof(uint16_t) + sizeof(uint8_t))));
+        heap_caps_free(pool->meta);
+        heap_caps_free(pool->usage_bitmap);
+        heap_caps_free(pool->pool_memory);
+        pool->meta = NULL;
+        pool->usage_bitmap = NULL;
+        pool->pool_memory = NULL;
+        return false;
     }
+    pool->owners = (uint8_t*)(pool->generations + index_capacity);
+
+    /* slab ที่ยังไม่มีและ bit ท้าย word ถือว่า "ใช้อยู่" เพื่อให้การค้นหาแบบ bitmap ข้ามไปเอง */
+    pool_bitmap_fill(pool, pool->base_block_count, pool->bitmap_words * 32 - pool->base_block_count, true);
+
+#if POOL_LAZY_CARVE
+    pool->free_list = NULL;   // ไม่แตะตัวบล็อกเลย: carve_next = 0 แจกจาก bump index
+    pool->carve_next = 0;
+#else
+    memory_block_t* tail;
+    pool->free_list = pool_carve(pool, (uint8_t*)pool->pool_memory, 0, pool->block_count, &tail);
+    pool->carve_next = pool->base_block_count;
+#endif
 
     pool->mutex = xSemaphoreCreateMutex();
     if (!pool->mutex) {
+        heap_caps_free(pool->generations);
+        heap_caps_free(pool->meta);
         heap_caps_free(pool->usage_bitmap);
         heap_caps_free(pool->pool_memory);
+        pool->generations = NULL;
+        pool->owners = NULL;
+        pool->meta = NULL;
         pool->usage_bitmap = NULL;
         pool->pool_memory = NULL;
         ESP_LOGE(TAG, "%s: failed to create mutex", pool->name);
         return false;
     }
 
-    ESP_LOGI(TAG, "✅ %s pool initialized: %u blocks × %uB = %uB", pool->name,
+    ESP_LOGI(TAG, "✅ %s pool initialized: %u blocks × %uB = %uB%s, grows by %u up to %u slabs",
+             pool->name,
              (unsigned)pool->block_count, (unsigned)pool->block_size,
-             (unsigned)(stride * pool->block_count));
+             (unsigned)(stride * pool->block_count),
+             pool->external_meta ? " (out-of-line metadata)" : "",
+             (unsigned)pool->slab_blocks, (unsigned)pool->max_slabs);
+    return true;
+}
+
+/* คืนพูลส่วนตัวของ benchmark (สร้างด้วย try_init_pool, ไม่โต, ไม่อยู่ใน pool_index) — ไม่มีใครถือบล็อกอยู่แล้ว */
+static void pool_destroy(memory_pool_t* pool)
+{
+    if (pool->mutex) vSemaphoreDelete(pool->mutex);
+    heap_caps_free(pool->lf_next);
+    heap_caps_free(pool->generations);
+    heap_caps_free(pool->meta);
+    heap_caps_free(pool->usage_bitmap);
+    heap_caps_free(pool->pool_memory);
+    memset(pool, 0, sizeof(*pool));
+}
+
+static void pool_index_insert(uintptr_t start, uintptr_t end, memory_pool_t* pool)
+{
+    portENTER_CRITICAL(&pool_index_lock);
+    if (pool_index_count < sizeof(pool_index) / sizeof(pool_index[0])) {
+        pool_index_seq++;
+        __sync_synchronize();
+        size_t i = pool_index_count++;
+        while (i > 0 && pool_index[i - 1].start > start) {
+            pool_index[i] = pool_index[i - 1];
+            i--;
+        }
+        pool_index[i] = (pool_range_t){ start, end, pool };
+        __sync_synchronize();
+        pool_index_seq++;
+    }
+    portEXIT_CRITICAL(&pool_index_lock);
+}
+
+static void pool_index_remove(uintptr_t start)
+{
+    portENTER_CRITICAL(&pool_index_lock);
+    pool_index_seq++;
+    __sync_synchronize();
+    for (size_t i = 0; i < pool_index_count; i++) {
+        if (pool_index[i].start != start) continue;
+        for (; i + 1 < pool_index_count; i++) pool_index[i] = pool_index[i + 1];
+        pool_index_count--;
+        break;
+    }
+    __sync_synchronize();
+    pool_index_seq++;
+    portEXIT_CRITICAL(&pool_index_lock);
+}
+
+static memory_pool_t* pool_index_lookup(const void* ptr)
+{
+    uintptr_t a = (uintptr_t)ptr;
+    memory_pool_t* found;
+    uint32_t seq;
+    do {
+        seq = pool_index_seq;
+        __sync_synchronize();
+        found = NULL;
+        size_t lo = 0, hi = pool_index_count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (a < pool_index[mid].start)      hi = mid;
+            else if (a >= pool_index[mid].end)  lo = mid + 1;
+            else { found = pool_index[mid].pool; break; }
+        }
+        __sync_synchronize();
+    } while ((seq & 1) || seq != pool_index_seq);
+    return found;
+}
+
+/* ลด block_count ลงครึ่งหนึ่งเรื่อย ๆ จนจองได้ (กันรีบูต) */
+static bool init_memory_pool_safely(memory_pool_t* pool, const pool_config_t* cfg, uint32_t pool_id)
+{
+    size_t count = cfg->block_count;
+    while (count >= 1) {
+        if (try_init_pool(pool, cfg, pool_id, count)) {
+            uintptr_t start = (uintptr_t)pool->pool_memory;
+            pool_index_insert(start, start + pool_stride(pool) * pool->base_block_count, pool);
+            return true;
+        }
+        count /= 2;
+        ESP_LOGW(TAG, "%s: retry with smaller block_count = %u", cfg->name, (unsigned)count);
+    }
+    return false;
+}
+
+/* ---------------- Latency recording ---------------- */
+static inline void pool_latency_record(pool_latency_hist_t* h, uint32_t cycles)
+{
+    int b = cycles ? 31 - __builtin_clz(cycles) : 0;
+    if (b >= POOL_LAT_BUCKETS) b = POOL_LAT_BUCKETS - 1;
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    if (cycles > h->max_cycles) h->max_cycles = cycles;   // approximate under contention
+}
+
+/* ขอบบนของ bucket ที่มี percentile pct (0-100) ตกอยู่ เป็น cycles; 0 = ยังไม่มีข้อมูล */
+static uint32_t pool_latency_percentile(const pool_latency_hist_t* h, uint32_t pct)
+{
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < POOL_LAT_BUCKETS; b++) total += h->buckets[b];
+    if (!total) return 0;
+    uint64_t target = (total * pct + 99) / 100;
+    for (int b = 0; b < POOL_LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= target) {
+            uint32_t upper = (b == POOL_LAT_BUCKETS - 1) ? h->max_cycles : (2u << b);
+            return upper < h->max_cycles ? upper : h->max_cycles;
+        }
+    }
+    return h->max_cycles;
+}
+
+/* xSemaphoreTake ของพูลที่จับเวลารอไว้ใน mutex_wait (ทั้งกรณีได้และ timeout) */
+static inline BaseType_t pool_mutex_take(memory_pool_t* pool, TickType_t timeout)
+{
+    uint32_t c0 = POOL_CYCLES();
+    BaseType_t ok = xSemaphoreTake(pool->mutex, timeout);
+    POOL_LATENCY(&pool->mutex_wait, c0);
+    if (ok == pdTRUE) __atomic_fetch_add(&pool->mutex_acquisitions, 1, __ATOMIC_RELAXED);
+    return ok;
+}
+
+/* ---------------- Stats snapshot (seqlock) ----------------
+   writer ทุกตัวของกลุ่ม allocated/peak/block_count/slab ถือ pool->lock อยู่แล้ว จึงเป็น writer เดียวต่อครั้ง;
+   ตัวนับสะสม (alloc/free/fail) เป็น atomic -> monitor อ่านได้โดยไม่แตะ mutex หรือ spinlock ของพูล
+   (LOCKFREE แก้ allocated_blocks ด้วย atomic นอก seqlock: ค่าแต่ละตัวถูกต้อง แต่อาจไม่ตรงกันเป๊ะ) */
+static inline void IRAM_ATTR pool_stats_write_begin(memory_pool_t* pool) {
+    pool->stats_seq++;
+    __sync_synchronize();
+}
+
+static inline void IRAM_ATTR pool_stats_write_end(memory_pool_t* pool) {
+    __sync_synchronize();
+    pool->stats_seq++;
+}
+
+typedef struct {
+    size_t block_count;
+    size_t allocated;        // รวมที่พักอยู่ใน magazine
+    size_t cached;
+    size_t in_use;
+    size_t peak;
+    uint64_t allocs;         // central + magazine
+    uint64_t frees;
+    uint32_t failures;
+    uint32_t refills;
+    uint32_t flushes;
+    uint32_t remote_frees;
+    uint32_t remote_reclaims;
+    uint32_t mutex_acquisitions;
+    uint32_t live_slabs;
+    uint32_t slab_grows;
+    uint32_t slab_shrinks;
+} pool_stats_t;
+
+/* ---------------- Central free list ----------------
+   free list/bitmap/allocated_blocks ถูกป้องกันด้วย spinlock pool->lock เพื่อให้ ISR ใช้ได้;
+   ฝั่ง task ยังถือ mutex ของพูลรอบ ๆ ไว้เหมือนเดิม (critical section จึงสั้นและไม่แย่งกันเอง) */
+static inline bool pool_has_free(const memory_pool_t* pool)
+{
+    if (pool->strategy == POOL_STRATEGY_BITMAP) return pool->allocated_blocks < pool->block_count;
+    if (pool->free_list || pool->carve_next < pool->base_block_count) return true;
+    for (size_t k = 0; k < pool->max_slabs; k++) {
+        if (pool->slabs[k].free_list) return true;
+    }
+    return false;
+}
+
+/* หัว free list หนึ่งตัว: ไม่ carve ไม่ scan — ทางเดียวที่ ISR ใช้จอง
+   base ก่อน แล้ว slab ตามลำดับ (≤ POOL_MAX_GROW_SLABS ช่อง จึงยังเป็น O(1)); slab ท้าย ๆ จึงว่างก่อนและคืนได้ */
+static inline memory_block_t* IRAM_ATTR pool_pop_list(memory_pool_t* pool, memory_block_t** corrupt)
+{
+    memory_block_t** head = &pool->free_list;
+    for (size_t k = 0; !*head && k < pool->max_slabs; k++) head = &pool->slabs[k].free_list;
+    memory_block_t* blk = *head;
+    if (!blk) return NULL;
+    if (pool->external_meta && !POOL_VERIFY(pool_owns_block(pool, blk))) {
+        /* next ถูกเขียนทับหลัง free — ตัด free list ทิ้งดีกว่าเดินต่อไปในหน่วยความจำมั่ว */
+        *head = NULL;
+        *corrupt = blk;
+        return NULL;
+    }
+    *head = blk->next;
+
+    if (!POOL_VERIFY(block_is(pool, blk, POOL_MAGIC_FREE))) {
+        *corrupt = blk;
+        return NULL;
+    }
+    blk->next = NULL;
+    return blk;
+}
+
+static inline void IRAM_ATTR pool_account_pop(memory_pool_t* pool, memory_block_t* blk)
+{
+    /* ทุกทางที่หยิบจาก free list กลาง (ISR/bulk/mutex/compaction) เริ่มแบบไม่มีเจ้าของ;
+       magazine_alloc ตั้งเจ้าของเองหลังหยิบ ไม่งั้น free จะส่งไป remote list ของ core เก่า */
+    if (pool->owners) pool->owners[pool_block_index(pool, blk)] = 0;
+    pool_stats_write_begin(pool);
+    pool->allocated_blocks++;
+    if (pool->allocated_blocks > pool->peak_usage) pool->peak_usage = pool->allocated_blocks;
+    pool_stats_write_end(pool);
+
+    /* set bitmap (slab ของบล็อกต้องรู้เสมอเพื่อนับ used ของ slab) */
+    size_t idx;
+    int slab = (pool->max_slabs || pool_tracks_bitmap(pool)) ? pool_locate(pool, blk, &idx) : POOL_SLAB_BASE;
+    if (slab != POOL_SLAB_NONE && pool_tracks_bitmap(pool)) pool_bitmap_set(pool, idx);
+    if (slab >= 0) {
+        pool->slabs[slab].used++;
+        pool->slabs[slab].idle_since = 0;
+    }
+}
+
+static inline memory_block_t* pool_pop_raw(memory_pool_t* pool, memory_block_t** corrupt)
+{
+    memory_block_t* blk = NULL;
+
+    if (pool->strategy == POOL_STRATEGY_BITMAP) {
+        for (size_t w = 0; w < pool->bitmap_words; w++) {
+            uint32_t free_bits = ~pool->usage_bitmap[w];
+            if (!free_bits) continue;
+            size_t idx = w * 32 + __builtin_ctz(free_bits);
+            if (idx < pool->base_block_count) pool_carve_upto(pool, idx + 1);
+            blk = pool_block_at(pool, idx);
+            if (blk && !POOL_VERIFY(block_is(pool, blk, POOL_MAGIC_FREE))) {
+                pool_bitmap_set(pool, idx);   // กักบล็อกเสียไว้ ไม่ให้ถูกหยิบซ้ำ
+                *corrupt = blk;
+                return NULL;
+            }
+            break;
+        }
+    } else if (pool->free_list || pool->carve_next >= pool->base_block_count) {
+        blk = pool_pop_list(pool, corrupt);
+    } else {
+        /* ใช้บล็อกที่คืนมาก่อน แล้วค่อยขยับ bump index — หน่วยความจำที่ไม่เคยใช้ก็ไม่ถูกแตะ */
+        blk = pool_block_at(pool, pool->carve_next);
+        pool_carve_upto(pool, pool->carve_next + 1);
+        blk->next = NULL;
+    }
+    if (!blk) return NULL;
+
+    pool_account_pop(pool, blk);
+    return blk;
+}
+
+static inline void IRAM_ATTR pool_push_raw(memory_pool_t* pool, memory_block_t* blk)
+{
+    size_t idx;
+    int slab = (pool->max_slabs || pool_tracks_bitmap(pool)) ? pool_locate(pool, blk, &idx) : POOL_SLAB_BASE;
+    if (slab != POOL_SLAB_NONE && pool_tracks_bitmap(pool)) pool_bitmap_clear(pool, idx);
+    if (slab >= 0 && pool->slabs[slab].used && --pool->slabs[slab].used == 0) {
+        pool->slabs[slab].idle_since = POOL_SLAB_IDLE_UNSTAMPED;   // ไม่อ่านนาฬิกาที่นี่ (ISR ก็มาทางนี้)
+    }
+    block_mark(pool, blk, POOL_MAGIC_FREE, 0);
+    if (pool->strategy == POOL_STRATEGY_FREELIST) {
+        memory_block_t** head = pool_free_head(pool, slab);
+        blk->next = *head;
+        *head = blk;
+    }
+    pool_stats_write_begin(pool);
+    if (pool->allocated_blocks) pool->allocated_blocks--;
+    pool_stats_write_end(pool);
+}
+
+/* ---------------- Lock-free stack (POOL_STRATEGY_LOCKFREE) ---------------- */
+#define LF_INDEX_MASK   0x0000FFFFu
+#define LF_TAG_STEP     0x00010000u
+
+static inline memory_block_t* IRAM_ATTR pool_lf_pop(memory_pool_t* pool)
+{
+    uint32_t old, next;
+    do {
+        old = pool->lf_head;
+        if (!(old & LF_INDEX_MASK)) return NULL;
+        next = pool->lf_next[(old & LF_INDEX_MASK) - 1];
+    } while (!esp_cpu_compare_and_set(&pool->lf_head, old, ((old + LF_TAG_STEP) & ~LF_INDEX_MASK) | next));
+
+    size_t idx = (old & LF_INDEX_MASK) - 1;
+    if (pool->owners) pool->owners[idx] = 0;
+    if (POOL_TRACK_BITMAP) __atomic_fetch_or(&pool->usage_bitmap[idx >> 5], 1u << (idx & 31), __ATOMIC_RELAXED);
+    size_t used = __atomic_add_fetch(&pool->allocated_blocks, 1, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&pool->peak_usage, __ATOMIC_RELAXED);
+    while (used > peak && !__atomic_compare_exchange_n(&pool->peak_usage, &peak, used, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* peak ถูกอัปเดตด้วยค่าล่าสุดแล้ว ลองใหม่จนกว่าจะไม่น้อยกว่า used */
+    }
+    return pool_block_at(pool, idx);
+}
+
+static inline void IRAM_ATTR pool_lf_push(memory_pool_t* pool, memory_block_t* blk)
+{
+    size_t idx = pool_block_index(pool, blk);
+    block_mark(pool, blk, POOL_MAGIC_FREE, 0);
+    if (POOL_TRACK_BITMAP) __atomic_fetch_and(&pool->usage_bitmap[idx >> 5], ~(1u << (idx & 31)), __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&pool->allocated_blocks, 1, __ATOMIC_RELAXED);
+
+    uint32_t old;
+    do {
+        old = pool->lf_head;
+        pool->lf_next[idx] = (uint16_t)(old & LF_INDEX_MASK);
+    } while (!esp_cpu_compare_and_set(&pool->lf_head, old,
+                                      ((old + LF_TAG_STEP) & ~LF_INDEX_MASK) | (uint32_t)(idx + 1)));
+}
+
+static memory_block_t* pool_pop_free(memory_pool_t* pool)
+{
+    memory_block_t* corrupt = NULL;
+    portENTER_CRITICAL(&pool->lock);
+    memory_block_t* blk = pool_pop_raw(pool, &corrupt);
+    portEXIT_CRITICAL(&pool->lock);
+
+    if (corrupt) {
+        ESP_LOGE(TAG, "🚨 %s: corruption on alloc blk=%p", pool->name, corrupt);
+        gpio_set_level(LED_POOL_ERROR, 1);
+    }
+    return blk;
+}
+
+static void pool_push_free(memory_pool_t* pool, memory_block_t* blk)
+{
+    portENTER_CRITICAL(&pool->lock);
+    pool_push_raw(pool, blk);
+    portEXIT_CRITICAL(&pool->lock);
+}
+
+/* ---------------- Slab growth/reclaim (pool mutex held, task context only) ---------------- */
+static int pool_free_slab_slot(const memory_pool_t* pool)
+{
+    for (int i = 0; i < (int)pool->max_slabs; i++) {
+        if (!pool->slabs[i].memory) return i;
+    }
+    return -1;
+}
+
+/* heap_caps_* อาจรอ heap lock ของระบบ: ปล่อย mutex ของพูลระหว่างขอหน่วยความจำ แล้วหาช่องใหม่หลังได้คืน
+   (task อื่นอาจโตพูลไปแล้วระหว่างนั้น) — ไม่ log บนทางนี้ monitor รายงาน grow/shrink ให้ */
+static bool pool_grow(memory_pool_t* pool)
+{
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE || pool_free_slab_slot(pool) < 0) return false;
+
+    const size_t bytes = pool_stride(pool) * pool->slab_blocks;
+    xSemaphoreGive(pool->mutex);
+    uint8_t* mem = (uint8_t*)heap_caps_aligned_alloc(pool->alignment, bytes, pool->caps);
+    if (!mem) {
+        ESP_LOGW(TAG, "%s: slab grow heap_caps_aligned_alloc(%uB) FAILED", pool->name, (unsigned)bytes);
+    }
+    pool_mutex_take(pool, portMAX_DELAY);
+    if (!mem) return false;
+
+    int k = pool_free_slab_slot(pool);
+    if (k < 0 || pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        xSemaphoreGive(pool->mutex);
+        heap_caps_free(mem);
+        pool_mutex_take(pool, portMAX_DELAY);
+        return k < 0;   // เต็มเพราะ task อื่นโตให้แล้ว: ให้ผู้เรียกเช็ค free ใหม่
+    }
+
+    const size_t first = pool->base_block_count + k * pool->slab_blocks;
+    memory_block_t* tail;
+    memory_block_t* head = pool_carve(pool, mem, first, pool->slab_blocks, &tail);
+    /* ลงทะเบียน index ก่อนปล่อยบล็อก เพื่อให้ smart_pool_free หาเจ้าของเจอเสมอ */
+    pool_index_insert((uintptr_t)mem, (uintptr_t)mem + bytes, pool);
+
+    portENTER_CRITICAL(&pool->lock);
+    pool->slabs[k].used = 0;
+    pool->slabs[k].idle_since = POOL_SLAB_IDLE_UNSTAMPED;
+    pool->slabs[k].free_list = head;
+    pool_stats_write_begin(pool);
+    pool->slabs[k].memory = mem;
+    pool_stats_write_end(pool);
+    pool_bitmap_fill(pool, first, pool->slab_blocks, false);
+    pool_stats_write_begin(pool);
+    pool->block_count += pool->slab_blocks;
+    pool->slab_grows++;
+    pool_stats_write_end(pool);
+    portEXIT_CRITICAL(&pool->lock);
+    return true;
+}
+
+static bool pool_ensure_free(memory_pool_t* pool, size_t n)
+{
+    while (pool->block_count - pool->allocated_blocks < n) {
+        if (!pool_grow(pool)) return false;
+    }
     return true;
 }
 
-/* ลด block_count ลงครึ่งหนึ่งเรื่อย ๆ จนจองได้ (กันรีบูต) */
-static bool init_memory_pool_safely(memory_pool_t* pool, const pool_config_t* cfg, uint32_t pool_id)
+/* คืน slab k ถ้าว่างทั้งก้อนมานาน idle_us แล้ว (0 = ทันที, หลัง compaction ย้ายของออกหมด); true = คืนแล้ว */
+static bool pool_release_slab(memory_pool_t* pool, int k, int64_t now, int64_t idle_us)
+{
+    pool_slab_t* slab = &pool->slabs[k];
+    uint8_t* mem = NULL;
+
+    portENTER_CRITICAL(&pool->lock);
+    if (slab->idle_since == POOL_SLAB_IDLE_UNSTAMPED) slab->idle_since = now;
+    if (slab->memory && slab->used == 0 && slab->idle_since &&
+        now - slab->idle_since >= idle_us) {
+        mem = slab->memory;
+        slab->free_list = NULL;   // used == 0: บล็อกทั้ง slab อยู่ใน list ของมันเองครบ ทิ้งทั้ง list ได้เลย
+        pool_bitmap_fill(pool, pool->base_block_count + k * pool->slab_blocks, pool->slab_blocks, true);
+        pool_stats_write_begin(pool);
+        slab->memory = NULL;
+        pool->block_count -= pool->slab_blocks;
+        pool->slab_shrinks++;
+        pool_stats_write_end(pool);
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    if (!mem) return false;
+    pool_index_remove((uintptr_t)mem);
+    heap_caps_free(mem);
+    ESP_LOGI(TAG, "📉 %s: released idle slab %d (now %u blocks)", pool->name, k,
+             (unsigned)pool->block_count);
+    return true;
+}
+
+static size_t pool_release_idle_slabs(memory_pool_t* pool, int64_t idle_us)
+{
+    const int64_t now = esp_timer_get_time();
+    size_t released = 0;
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) return 0;
+
+    for (int k = 0; k < (int)pool->max_slabs; k++) {
+        if (pool_release_slab(pool, k, now, idle_us)) released++;
+    }
+    return released;
+}
+
+/* ---------------- Magazine layer ---------------- */
+/* ย้าย block ที่ค้างอยู่ใน magazine ทุก core กลับ free list กลาง (ต้องถือ mutex อยู่) */
+static size_t pool_reclaim_magazines(memory_pool_t* pool)
+{
+    size_t reclaimed = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        pool_magazine_t* mag = &pool->magazines[c];
+        memory_block_t* batch[POOL_MAGAZINE_SIZE];
+        uint32_t n;
+        portENTER_CRITICAL(&mag->lock);
+        n = mag->count;
+        memcpy(batch, mag->blocks, n * sizeof(batch[0]));
+        mag->count = 0;
+        portEXIT_CRITICAL(&mag->lock);
+        for (uint32_t i = 0; i < n; i++) pool_push_free(pool, batch[i]);
+        reclaimed += n;
+
+        memory_block_t* remote = __atomic_exchange_n(&mag->remote_head, NULL, __ATOMIC_ACQUIRE);
+        for (n = 0; remote; n++) {
+            memory_block_t* next = remote->next;
+            pool_push_free(pool, remote);
+            remote = next;
+        }
+        __atomic_fetch_sub(&mag->remote_count, n, __ATOMIC_RELAXED);
+        reclaimed += n;
+    }
+    return reclaimed;
+}
+
+static size_t pool_cached_blocks(const memory_pool_t* pool)
+{
+    size_t cached = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        cached += pool->magazines[c].count + pool->magazines[c].remote_count;
+    }
+    return cached;
+}
+
+/* blocks ที่ผู้ใช้ถืออยู่จริง (ไม่นับที่พักอยู่ใน magazine หรือ remote list) */
+static size_t pool_blocks_in_use(const memory_pool_t* pool)
+{
+    size_t cached = pool_cached_blocks(pool);
+    return (pool->allocated_blocks > cached) ? pool->allocated_blocks - cached : 0;
+}
+
+static inline void magazine_set_owner(memory_pool_t* pool, memory_block_t* blk)
+{
+    if (pool->owners) pool->owners[pool_block_index(pool, blk)] = (uint8_t)(xPortGetCoreID() + 1);
+}
+
+/* ผู้เรียกนับ remote_count เอง (บวกก่อน push) เพื่อให้ตัวนับไม่ต่ำกว่าจำนวนจริงและไม่ติดลบ */
+static void remote_list_push(pool_magazine_t* mag, memory_block_t* first, memory_block_t* last)
+{
+    memory_block_t* head = __atomic_load_n(&mag->remote_head, __ATOMIC_RELAXED);
+    do {
+        last->next = head;
+    } while (!__atomic_compare_exchange_n(&mag->remote_head, &head, first, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* เจ้าของดึง remote list ทั้งก้อน: ตัวแรกคืนให้ผู้เรียก ที่เหลือเติม magazine, ล้นเมื่อไหร่ค่อยแขวนกลับ */
+static memory_block_t* magazine_reclaim_remote(pool_magazine_t* mag)
+{
+    if (!__atomic_load_n(&mag->remote_head, __ATOMIC_RELAXED)) return NULL;
+    memory_block_t* list = __atomic_exchange_n(&mag->remote_head, NULL, __ATOMIC_ACQUIRE);
+    if (!list) return NULL;
+
+    memory_block_t* blk = list;
+    uint32_t taken = 1;
+    list = list->next;
+    portENTER_CRITICAL(&mag->lock);
+    mag->allocs++;
+    mag->remote_reclaims++;
+    while (list && mag->count < POOL_MAGAZINE_SIZE) {
+        mag->blocks[mag->count++] = list;
+        list = list->next;
+        taken++;
+    }
+    portEXIT_CRITICAL(&mag->lock);
+    __atomic_fetch_sub(&mag->remote_count, taken, __ATOMIC_RELAXED);
+
+    if (list) {
+        memory_block_t* last = list;
+        while (last->next) last = last->next;
+        remote_list_push(mag, list, last);
+    }
+    return blk;
+}
+
+static void pool_warn_exhausted(memory_pool_t* pool)
+{
+    if (pool->quiet_exhaustion) {
+        __atomic_fetch_add(&pool->quiet_exhaustion_count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    ESP_LOGW(TAG, "🔴 %s: pool exhausted %u/%u", pool->name,
+             (unsigned)pool->allocated_blocks, (unsigned)pool->block_count);
+}
+
+static memory_block_t* magazine_alloc(memory_pool_t* pool)
+{
+    pool_magazine_t* mag = &pool->magazines[xPortGetCoreID()];
+    memory_block_t* blk = NULL;
+
+    portENTER_CRITICAL(&mag->lock);
+    if (mag->count) {
+        blk = mag->blocks[--mag->count];
+        mag->allocs++;
+    }
+    portEXIT_CRITICAL(&mag->lock);
+    if (!blk) blk = magazine_reclaim_remote(mag);
+    if (blk) {
+        magazine_set_owner(pool, blk);
+        return blk;
+    }
+
+    /* slow path: เติมทีละชุดจาก free list กลาง */
+    memory_block_t* batch[POOL_MAGAZINE_BATCH];
+    size_t n = 0;
+    if (pool_mutex_take(pool, pdMS_TO_TICKS(50)) != pdTRUE) return NULL;
+    if (!pool_has_free(pool)) {
+        /* core อื่นถือ block ว่างไว้ — ดึงกลับมาก่อน, ถ้ายังไม่มีจึงขอ slab เพิ่ม */
+        pool_reclaim_magazines(pool);
+        if (!pool_has_free(pool)) pool_ensure_free(pool, 1);
+    }
+    while (n < POOL_MAGAZINE_BATCH) {
+        memory_block_t* b = pool_pop_free(pool);
+        if (!b) break;
+        batch[n++] = b;
+    }
+    if (n == 0) {
+        __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+        gpio_set_level(LED_POOL_FULL, 1);
+        pool_warn_exhausted(pool);
+        xSemaphoreGive(pool->mutex);
+        return NULL;
+    }
+    xSemaphoreGive(pool->mutex);
+
+    blk = batch[--n];
+    magazine_set_owner(pool, blk);
+    portENTER_CRITICAL(&mag->lock);
+    mag->allocs++;
+    mag->refills++;
+    while (n && mag->count < POOL_MAGAZINE_SIZE) mag->blocks[mag->count++] = batch[--n];
+    portEXIT_CRITICAL(&mag->lock);
+
+    if (n) {
+        /* task อื่นบน core เดียวกันเติมไปก่อนแล้ว — คืนส่วนเกิน */
+        pool_mutex_take(pool, portMAX_DELAY);
+        while (n) pool_push_free(pool, batch[--n]);
+        xSemaphoreGive(pool->mutex);
+    }
+    return blk;
+}
+
+static void magazine_free(memory_pool_t* pool, memory_block_t* blk)
+{
+    const int core = xPortGetCoreID();
+    if (!pool->no_remote_free && pool->owners) {
+        const uint8_t owner = pool->owners[pool_block_index(pool, blk)];
+        if (owner && owner != core + 1) {
+            pool_magazine_t* home = &pool->magazines[owner - 1];
+            __atomic_fetch_add(&home->remote_count, 1, __ATOMIC_RELAXED);
+            remote_list_push(home, blk, blk);
+            __atomic_fetch_add(&home->remote_frees, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    pool_magazine_t* mag = &pool->magazines[core];
+    memory_block_t* spill[POOL_MAGAZINE_BATCH];
+    size_t n = 0;
+
+    portENTER_CRITICAL(&mag->lock);
+    if (mag->count == POOL_MAGAZINE_SIZE) {
+        /* เต็ม: flush block ที่เก่าที่สุด (ก้น stack) ออกหนึ่งชุด, เก็บตัวที่ยังร้อนใน cache ไว้ */
+        n = POOL_MAGAZINE_BATCH;
+        memcpy(spill, mag->blocks, n * sizeof(spill[0]));
+        memmove(mag->blocks, mag->blocks + n, (mag->count - n) * sizeof(mag->blocks[0]));
+        mag->count -= n;
+        mag->flushes++;
+    }
+    mag->blocks[mag->count++] = blk;
+    mag->frees++;
+    portEXIT_CRITICAL(&mag->lock);
+
+    if (n) {
+        pool_mutex_take(pool, portMAX_DELAY);
+        while (n) pool_push_free(pool, spill[--n]);
+        xSemaphoreGive(pool->mutex);
+    }
+}
+
+/* เปิด/ปิด magazine cache ของพูลเดียว; ตอนปิดจะคืน block ที่ค้างอยู่ทั้งหมดให้ free list กลาง */
+static void pool_set_magazines(memory_pool_t* pool, bool enabled)
+{
+    pool->no_magazines = !enabled;
+    if (enabled) return;
+    xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    pool_reclaim_magazines(pool);
+    xSemaphoreGive(pool->mutex);
+}
+
+/* RELEASE policy ไม่อัปเดต bitmap บน fast path: สร้างใหม่จาก free list/LF stack/bump index
+   (ถือ pool->lock อยู่, magazine ถูกเทกลับแล้ว) */
+static void pool_bitmap_sync(memory_pool_t* pool)
+{
+    if (pool_tracks_bitmap(pool)) return;
+    pool_bitmap_fill(pool, 0, pool->bitmap_words * 32, true);
+    pool_bitmap_fill(pool, pool->carve_next, pool->base_block_count - pool->carve_next, false);
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        for (uint32_t i = pool->lf_head & LF_INDEX_MASK; i; i = pool->lf_next[i - 1]) pool_bitmap_clear(pool, i - 1);
+    } else {
+        for (int k = POOL_SLAB_BASE; k < (int)pool->max_slabs; k++) {
+            for (memory_block_t* b = *pool_free_head(pool, k); b; b = b->next) {
+                pool_bitmap_clear(pool, pool_block_index(pool, b));
+            }
+        }
+    }
+}
+
+/* สลับกลยุทธ์การจองของพูล: BITMAP ไม่ใช้ free list, FREELIST สร้าง list ใหม่จาก bit ว่าง
+   (เรียงให้ address ต่ำอยู่หัว list) */
+static void pool_set_strategy(memory_pool_t* pool, pool_strategy_t strategy)
+{
+    if (!pool->mutex || pool->strategy == strategy) return;
+    if (strategy == POOL_STRATEGY_LOCKFREE && !pool->lf_next) {
+        pool->lf_next = (uint16_t*) heap_caps_calloc(pool->bitmap_words * 32, sizeof(uint16_t), MALLOC_CAP_INTERNAL);
+        if (!pool->lf_next) {
+            ESP_LOGW(TAG, "%s: lock-free next table alloc FAILED", pool->name);
+            return;
+        }
+    }
+    /* ผู้เรียกต้องแน่ใจว่าไม่มีใครใช้พูลแบบ LOCKFREE อยู่ระหว่างสลับ (ทางนั้นไม่ถือ mutex) */
+    xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    pool_reclaim_magazines(pool);
+    portENTER_CRITICAL(&pool->lock);
+    pool_bitmap_sync(pool);
+    /* LOCKFREE ไม่มี bump index (pop เป็น CAS ล้วน) จึง carve ส่วนที่เหลือให้ครบก่อน */
+    if (strategy == POOL_STRATEGY_LOCKFREE) pool_carve_upto(pool, pool->base_block_count);
+    pool->free_list = NULL;
+    for (size_t k = 0; k < pool->max_slabs; k++) pool->slabs[k].free_list = NULL;
+    pool->lf_head = 0;
+    for (size_t idx = pool->bitmap_words * 32; idx-- > 0; ) {
+        if (strategy == POOL_STRATEGY_BITMAP) break;
+        if (pool->usage_bitmap[idx >> 5] & (1u << (idx & 31))) continue;
+        if (idx >= pool->carve_next && idx < pool->base_block_count) continue;   // ยังอยู่หลัง bump index
+        memory_block_t* blk = pool_block_at(pool, idx);
+        if (!blk) continue;
+        if (strategy == POOL_STRATEGY_FREELIST) {
+            memory_block_t** head = pool_free_head(pool, pool_index_slab(pool, idx));
+            blk->next = *head;
+            *head = blk;
+        } else {
+            pool->lf_next[idx] = (uint16_t)(pool->lf_head & LF_INDEX_MASK);
+            pool->lf_head = (uint32_t)(idx + 1);
+        }
+    }
+    pool->strategy = strategy;
+    portEXIT_CRITICAL(&pool->lock);
+    xSemaphoreGive(pool->mutex);
+}
+
+/* ---------------- Allocation/Free ---------------- */
+static void* pool_malloc(memory_pool_t* pool)
+{
+    if (!pool || !pool->mutex) return NULL;
+    uint64_t t0 = POOL_TIME_NOW();
+    uint32_t c0 = POOL_CYCLES();
+    void* out = NULL;
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        memory_block_t* blk = pool_lf_pop(pool);
+        if (blk && POOL_VERIFY(block_is(pool, blk, POOL_MAGIC_FREE))) {
+            block_mark(pool, blk, POOL_MAGIC_ALLOC, POOL_TIME_NOW());
+            __atomic_fetch_add(&pool->total_allocations, 1, __ATOMIC_RELAXED);
+            out = block_to_user(pool, blk);
+        } else if (blk) {
+            ESP_LOGE(TAG, "🚨 %s: corruption on lock-free alloc blk=%p", pool->name, blk);
+            gpio_set_level(LED_POOL_ERROR, 1);
+        } else {
+            __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+        }
+    } else if (!pool->no_magazines) {
+        memory_block_t* blk = magazine_alloc(pool);
+        if (blk) {
+            block_mark(pool, blk, POOL_MAGIC_ALLOC, POOL_TIME_NOW());
+            out = block_to_user(pool, blk);
+        }
+    } else if (pool_mutex_take(pool, pdMS_TO_TICKS(50)) == pdTRUE) {
+        if (!pool_has_free(pool)) pool_ensure_free(pool, 1);
+        if (pool_has_free(pool)) {
+            memory_block_t* blk = pool_pop_free(pool);
+            if (blk) {
+                block_mark(pool, blk, POOL_MAGIC_ALLOC, POOL_TIME_NOW());
+                __atomic_fetch_add(&pool->total_allocations, 1, __ATOMIC_RELAXED);
+                out = block_to_user(pool, blk);
+            }
+        } else {
+            __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+            gpio_set_level(LED_POOL_FULL, 1);
+            pool_warn_exhausted(pool);
+        }
+        xSemaphoreGive(pool->mutex);
+    }
+
+    POOL_LATENCY(&pool->alloc_latency, c0);
+    pool->allocation_time_total += (POOL_TIME_NOW() - t0);
+    return out;
+}
+
+/* retire = false: ผู้เรียกเลื่อน generation ไปแล้วตอนตรวจ handle */
+static bool pool_free_block(memory_pool_t* pool, void* ptr, bool retire)
+{
+    if (!pool || !ptr || !pool->mutex) return false;
+    uint64_t t0 = POOL_TIME_NOW();
+    uint32_t c0 = POOL_CYCLES();
+    bool ok = false;
+    memory_block_t* blk = user_to_block(pool, ptr);
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        if (POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk))) {
+            if (retire) block_retire(pool, blk);
+            pool_lf_push(pool, blk);
+            __atomic_fetch_add(&pool->total_deallocations, 1, __ATOMIC_RELAXED);
+            ok = true;
+        } else {
+            ESP_LOGE(TAG, "🚨 invalid free %p for %s", ptr, pool->name);
+            gpio_set_level(LED_POOL_ERROR, 1);
+        }
+    } else if (!pool->no_magazines &&
+               POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk))) {
+        if (retire) block_retire(pool, blk);
+        block_mark(pool, blk, POOL_MAGIC_FREE, 0);
+        magazine_free(pool, blk);
+        ok = true;
+    } else if (pool_mutex_take(pool, pdMS_TO_TICKS(50)) == pdTRUE) {
+        /* verify bounds */
+        if (!POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk))) {
+            ESP_LOGE(TAG, "🚨 invalid free %p for %s (magic=0x%08X)",
+                     ptr, pool->name, pool_owns_block(pool, blk) ? block_magic(pool, blk) : 0);
+            gpio_set_level(LED_POOL_ERROR, 1);
+        } else {
+            if (retire) block_retire(pool, blk);
+            pool_push_free(pool, blk);
+            __atomic_fetch_add(&pool->total_deallocations, 1, __ATOMIC_RELAXED);
+            ok = true;
+        }
+        xSemaphoreGive(pool->mutex);
+    }
+
+    POOL_LATENCY(&pool->free_latency, c0);
+    pool->deallocation_time_total += (POOL_TIME_NOW() - t0);
+    return ok;
+}
+
+static bool pool_free(memory_pool_t* pool, void* ptr)
+{
+    return pool_free_block(pool, ptr, true);
+}
+
+/* ---------------- Bulk Allocation/Free ----------------
+   ตัด/ต่อ free list ทีละหลายบล็อกภายใต้ mutex + spinlock ครั้งเดียว (ไม่ผ่าน magazine)
+   คืนจำนวนบล็อกที่ทำได้จริง ซึ่งอาจน้อยกว่า n ถ้าพูลเหลือไม่พอ */
+static size_t pool_malloc_bulk(memory_pool_t* pool, size_t n, void* out[])
+{
+    if (!pool || !pool->mutex || !out || n == 0) return 0;
+    uint64_t t0 = POOL_TIME_NOW();
+    memory_block_t* corrupt = NULL;
+    size_t got = 0;
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        /* ไม่มี lock ให้รวบ — แต่ละตัวเป็น CAS อยู่แล้ว */
+        while (got < n && (out[got] = pool_malloc(pool)) != NULL) got++;
+        return got;
+    }
+
+    if (pool_mutex_take(pool, pdMS_TO_TICKS(50)) == pdTRUE) {
+        pool_ensure_free(pool, n);
+        portENTER_CRITICAL(&pool->lock);
+        while (got < n && !corrupt) {
+            memory_block_t* blk = pool_pop_raw(pool, &corrupt);
+            if (!blk) break;
+            out[got++] = blk;
+        }
+        portEXIT_CRITICAL(&pool->lock);
+
+        uint64_t now = POOL_TIME_NOW();
+        for (size_t i = 0; i < got; i++) {
+            memory_block_t* blk = (memory_block_t*)out[i];
+            block_mark(pool, blk, POOL_MAGIC_ALLOC, now);
+            out[i] = block_to_user(pool, blk);
+        }
+        __atomic_fetch_add(&pool->total_allocations, got, __ATOMIC_RELAXED);
+        if (got < n) __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+        xSemaphoreGive(pool->mutex);
+    }
+
+    if (corrupt) {
+        ESP_LOGE(TAG, "🚨 %s: corruption on bulk alloc blk=%p", pool->name, corrupt);
+        gpio_set_level(LED_POOL_ERROR, 1);
+    }
+    pool->allocation_time_total += (POOL_TIME_NOW() - t0);
+    return got;
+}
+
+static size_t pool_free_bulk(memory_pool_t* pool, size_t n, void* const ptrs[])
+{
+    if (!pool || !pool->mutex || !ptrs || n == 0) return 0;
+    uint64_t t0 = POOL_TIME_NOW();
+    size_t freed = 0;
+    size_t non_null = 0;    // NULL ข้ามได้ตามสัญญา ไม่นับเป็น pointer ที่ถูกปฏิเสธ
+    for (size_t i = 0; i < n; i++) if (ptrs[i]) non_null++;
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        for (size_t i = 0; i < n; i++) if (ptrs[i] && pool_free(pool, ptrs[i])) freed++;
+        return freed;
+    }
+
+    if (pool_mutex_take(pool, pdMS_TO_TICKS(50)) == pdTRUE) {
+        portENTER_CRITICAL(&pool->lock);
+        for (size_t i = 0; i < n; i++) {
+            if (!ptrs[i]) continue;
+            memory_block_t* blk = user_to_block(pool, ptrs[i]);
+            if (!POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk))) continue;
+            block_retire(pool, blk);
+            pool_push_raw(pool, blk);
+            freed++;
+        }
+        portEXIT_CRITICAL(&pool->lock);
+        __atomic_fetch_add(&pool->total_deallocations, freed, __ATOMIC_RELAXED);
+        xSemaphoreGive(pool->mutex);
+    }
+
+    if (freed < non_null) {
+        ESP_LOGE(TAG, "🚨 %s: bulk free rejected %u of %u pointers", pool->name,
+                 (unsigned)(non_null - freed), (unsigned)non_null);
+        gpio_set_level(LED_POOL_ERROR, 1);
+    }
+    pool->deallocation_time_total += (POOL_TIME_NOW() - t0);
+    return freed;
+}
+
+/* ---------------- Handle API ---------------- */
+static pool_handle_t pool_malloc_handle(memory_pool_t* pool)
+{
+    void* p = pool_malloc(pool);
+    if (!p) return POOL_HANDLE_INVALID;
+    size_t idx = pool_block_index(pool, user_to_block(pool, p));
+    return POOL_HANDLE_MAKE(pool->pool_id, pool->generations[idx], idx);
+}
+
+static inline memory_pool_t* pool_handle_pool(pool_handle_t h)
+{
+    uint32_t pid = POOL_HANDLE_POOL_ID(h);
+    if (pid == 0 || pid > POOL_COUNT || !pools[pid - 1].generations) return NULL;
+    return &pools[pid - 1];
+}
+
+/* generations มีแค่ index_capacity ช่อง (base + ทุก slab) — bit padding ท้าย bitmap ไม่มี generation */
+static void* pool_handle_block_ptr(memory_pool_t* pool, pool_handle_t h)
+{
+    size_t idx = POOL_HANDLE_INDEX(h);
+    if (idx >= pool->base_block_count + pool->max_slabs * pool->slab_blocks) return NULL;
+    if ((pool->generations[idx] & POOL_HANDLE_GEN_MASK) != POOL_HANDLE_GEN(h)) return NULL;
+    if (pool_tracks_bitmap(pool) && !(pool->usage_bitmap[idx >> 5] & (1u << (idx & 31)))) return NULL;
+    memory_block_t* blk = pool_block_at(pool, idx);
+    return blk ? block_to_user(pool, blk) : NULL;
+}
+
+/* handle -> pointer หรือ NULL ถ้า handle ถูก free ไปแล้ว/ถูกจองใหม่ (generation ไม่ตรง) */
+static void* pool_handle_ptr(pool_handle_t h)
+{
+    memory_pool_t* pool = pool_handle_pool(h);
+    return pool ? pool_handle_block_ptr(pool, h) : NULL;
+}
+
+static bool pool_free_handle(pool_handle_t h)
+{
+    memory_pool_t* pool = pool_handle_pool(h);
+    void* p = NULL;
+    if (pool) {
+        /* ตรวจ generation แล้วเลื่อนทันทีใน spinlock เดียวกัน: handle เดิมที่ free ซ้ำ หรือบล็อกที่ถูก free
+           แล้วจองใหม่ระหว่างตรวจ จะเห็น generation ใหม่เสมอ ไม่หลุดไป free บล็อกของเจ้าของใหม่ */
+        portENTER_CRITICAL(&pool->lock);
+        p = pool_handle_block_ptr(pool, h);
+        if (p) block_retire(pool, user_to_block(pool, p));
+        portEXIT_CRITICAL(&pool->lock);
+    }
+    if (!p) {
+        ESP_LOGE(TAG, "🚨 stale or invalid handle 0x%08X", (unsigned)h);
+        gpio_set_level(LED_POOL_ERROR, 1);
+        return false;
+    }
+    return pool_free_block(pool, p, false);
+}
+
+/* ---------------- Movable allocations (Large/Huge) ----------------
+   opt-in: ผู้ใช้ถือ handle แทน pointer และ lock/unlock รอบการเข้าถึงแต่ละครั้ง
+   block ที่ไม่ถูก lock อยู่ย้ายได้ -> compaction ใน pool_monitor_task ขนของออกจาก growth slab
+   ไปลงช่องว่างใน base/slab อื่นแล้วคืน slab ทั้งก้อนให้ heap ทันที
+   handle = [generation:16][slot+1:16], 0 = invalid */
+#define POOL_MOVABLE_MAX         16
+#define POOL_COMPACT_ENABLED     1
+#define POOL_COMPACT_STASH       8     // free blocks of the victim slab set aside while picking targets
+
+typedef uint32_t pool_movable_t;
+#define POOL_MOVABLE_INVALID     0u
+
+typedef struct {
+    memory_pool_t* pool;     // NULL = slot unused
+    void* ptr;               // valid only while pinned
+    uint16_t generation;
+    uint16_t pins;
+    bool moving;             // compaction copying this block right now
+} movable_entry_t;
+
+static movable_entry_t movable_table[POOL_MOVABLE_MAX];
+static portMUX_TYPE movable_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* bit i = slot i ไม่ได้ถูกย้ายอยู่: compaction ล้าง bit ก่อนตั้ง moving แล้ว set หลังย้ายเสร็จ
+   task ที่เจอ moving รอ bit นี้แทนการ poll (ตื่นพร้อมกันได้หลายตัว) */
+static StaticEventGroup_t movable_events_buf;
+static EventGroupHandle_t movable_events;
+#define MOVABLE_MOVED_BIT(slot)  ((EventBits_t)1 << (slot))
+_Static_assert(POOL_MOVABLE_MAX <= 24, "one event-group bit per movable slot");
+
+typedef struct {
+    uint32_t passes;
+    uint32_t blocks_moved;
+    uint64_t bytes_moved;
+    uint64_t time_us;
+    uint32_t slabs_released;
+    uint32_t skipped_pinned;     // slab มี movable block ที่ถูก lock อยู่
+    uint32_t skipped_unmovable;  // slab มี block ธรรมดา (ไม่ใช่ movable) ที่ย้ายไม่ได้
+} pool_compaction_stats_t;
+
+/* รวมทุกพูล (monitor ทำ Huge, selftest ทำ Large พร้อมกันได้): บวก/อ่านภายใต้ movable_lock */
+static pool_compaction_stats_t compaction_stats;
+
+static void movable_init(void)
+{
+    movable_events = xEventGroupCreateStatic(&movable_events_buf);
+    xEventGroupSetBits(movable_events, MOVABLE_MOVED_BIT(POOL_MOVABLE_MAX) - 1);
+}
+
+static inline void movable_wait_moved(pool_movable_t h)
+{
+    xEventGroupWaitBits(movable_events, MOVABLE_MOVED_BIT((h & 0xFFFFu) - 1), pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+/* คืน entry ที่ handle ชี้ถ้ายังถูกต้อง (ต้องถือ movable_lock) */
+static inline movable_entry_t* movable_entry(pool_movable_t h)
+{
+    uint32_t slot = (h & 0xFFFFu) - 1;
+    if (h == POOL_MOVABLE_INVALID || slot >= POOL_MOVABLE_MAX) return NULL;
+    movable_entry_t* e = &movable_table[slot];
+    return (e->pool && e->generation == (uint16_t)(h >> 16)) ? e : NULL;
+}
+
+/* ขนาด <= Large block ได้ Large, ที่เหลือถึง Huge block ได้ Huge; ใหญ่กว่านั้น INVALID */
+static pool_movable_t movable_malloc(size_t size)
+{
+    memory_pool_t* pool = size <= pools[POOL_LARGE].block_size ? &pools[POOL_LARGE] :
+                          size <= pools[POOL_HUGE].block_size  ? &pools[POOL_HUGE]  : NULL;
+    if (!pool || !pool->mutex) return POOL_MOVABLE_INVALID;
+    void* p = pool_malloc(pool);
+    if (!p) return POOL_MOVABLE_INVALID;
+
+    pool_movable_t h = POOL_MOVABLE_INVALID;
+    portENTER_CRITICAL(&movable_lock);
+    for (uint32_t i = 0; i < POOL_MOVABLE_MAX; i++) {
+        movable_entry_t* e = &movable_table[i];
+        if (e->pool) continue;
+        e->pool = pool;
+        e->ptr = p;
+        e->pins = 0;
+        e->moving = false;
+        h = ((uint32_t)e->generation << 16) | (i + 1);
+        break;
+    }
+    portEXIT_CRITICAL(&movable_lock);
+
+    if (h == POOL_MOVABLE_INVALID) {
+        ESP_LOGW(TAG, "movable table full (%d)", POOL_MOVABLE_MAX);
+        pool_free(pool, p);
+    }
+    return h;
+}
+
+/* pin แล้วคืน pointer; ถ้า compaction กำลังคัดลอก block นี้อยู่ให้รอจนย้ายเสร็จ */
+static void* movable_lock_ptr(pool_movable_t h)
+{
+    for (;;) {
+        void* p = NULL;
+        bool busy = false;
+        portENTER_CRITICAL(&movable_lock);
+        movable_entry_t* e = movable_entry(h);
+        if (e && e->moving) {
+            busy = true;
+        } else if (e) {
+            e->pins++;
+            p = e->ptr;
+        }
+        portEXIT_CRITICAL(&movable_lock);
+        if (!busy) return p;
+        movable_wait_moved(h);
+    }
+}
+
+static void movable_unlock(pool_movable_t h)
+{
+    portENTER_CRITICAL(&movable_lock);
+    movable_entry_t* e = movable_entry(h);
+    if (e && e->pins) e->pins--;
+    portEXIT_CRITICAL(&movable_lock);
+}
+
+static bool movable_free(pool_movable_t h)
+{
+    for (;;) {
+        memory_pool_t* pool = NULL;
+        void* p = NULL;
+        bool busy = false, pinned = false;
+        portENTER_CRITICAL(&movable_lock);
+        movable_entry_t* e = movable_entry(h);
+        if (e && e->moving) {
+            busy = true;
+        } else if (e && e->pins) {
+            pinned = true;
+        } else if (e) {
+            pool = e->pool;
+            p = e->ptr;
+            e->pool = NULL;
+            e->ptr = NULL;
+            e->generation++;
+        }
+        portEXIT_CRITICAL(&movable_lock);
+        if (busy) { movable_wait_moved(h); continue; }
+        if (!pool) {
+            ESP_LOGE(TAG, "🚨 %s movable handle 0x%08X", pinned ? "free of locked" : "stale or invalid",
+                     (unsigned)h);
+            gpio_set_level(LED_POOL_ERROR, 1);
+            return false;
+        }
+        return pool_free(pool, p);
+    }
+}
+
+/* เลือก slab ที่ used น้อยสุดซึ่งทุก block ที่ใช้อยู่เป็น movable ที่ไม่ถูก lock และที่ว่างนอก slab พอรับ
+   (ถือ mutex ของพูลอยู่, magazine ถูกเทกลับแล้ว); -1 = ไม่มี */
+static int pool_compact_pick_slab(memory_pool_t* pool, pool_compaction_stats_t* st)
+{
+    const size_t bytes = pool_stride(pool) * pool->slab_blocks;
+    int victim = -1;
+    for (int k = 0; k < (int)pool->max_slabs; k++) {
+        const pool_slab_t* slab = &pool->slabs[k];
+        if (!slab->memory || slab->used == 0) continue;
+        size_t free_outside = (pool->block_count - pool->allocated_blocks) - (pool->slab_blocks - slab->used);
+        if (free_outside < slab->used) continue;
+
+        size_t movable = 0, pinned = 0;
+        portENTER_CRITICAL(&movable_lock);
+        for (int i = 0; i < POOL_MOVABLE_MAX; i++) {
+            const movable_entry_t* e = &movable_table[i];
+            if (e->pool != pool) continue;
+            uint8_t* blk = (uint8_t*)user_to_block(pool, e->ptr);
+            if (blk < slab->memory || blk >= slab->memory + bytes) continue;
+            if (e->pins) pinned++;
+            else movable++;
+        }
+        portEXIT_CRITICAL(&movable_lock);
+
+        if (pinned) {
+            st->skipped_pinned++;
+            continue;
+        }
+        if (movable != slab->used) {
+            st->skipped_unmovable++;
+            continue;
+        }
+        if (victim < 0 || slab->used < pool->slabs[victim].used) victim = k;
+    }
+    return victim;
+}
+
+/* ย้าย movable block ทั้งหมดออกจาก slab หนึ่งก้อนแล้วคืนเฉพาะ slab นั้น (slab อื่นที่ว่างรอ hysteresis
+   ของ pool_release_idle_slabs ตามปกติ); คืนจำนวน slab ที่ปล่อยได้, *out = ผลของรอบนี้ (NULL ได้)
+   เลือกคู่ src/dst ภายใต้ mutex, คัดลอกข้อมูลนอก mutex (entry ถูกตั้ง moving กันไว้แล้ว),
+   แล้วค่อยกลับมาคืน src และ slab ภายใต้ mutex อีกครั้ง */
+static size_t pool_compact(memory_pool_t* pool, pool_compaction_stats_t* out)
+{
+    pool_compaction_stats_t st = {0};
+    size_t released = 0;
+#if POOL_COMPACT_ENABLED
+    if (!pool->mutex || !pool->max_slabs || pool->strategy == POOL_STRATEGY_LOCKFREE) goto done;
+    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) != pdTRUE) goto done;
+
+    const uint64_t t0 = esp_timer_get_time();
+    pool_reclaim_magazines(pool);
+    int k = pool_compact_pick_slab(pool, &st);
+    if (k < 0) {
+        xSemaphoreGive(pool->mutex);
+        goto done;
+    }
+
+    uint8_t* const mem = pool->slabs[k].memory;
+    const size_t bytes = pool_stride(pool) * pool->slab_blocks;
+    memory_block_t* stash[POOL_COMPACT_STASH];
+    size_t stashed = 0;
+    struct { int slot; void* src; memory_block_t* dst; } moves[POOL_MOVABLE_MAX];
+    size_t n = 0;
+
+    for (int i = 0; i < POOL_MOVABLE_MAX; i++) {
+        movable_entry_t* e = &movable_table[i];
+        portENTER_CRITICAL(&movable_lock);
+        uint8_t* b = e->pool == pool ? (uint8_t*)user_to_block(pool, e->ptr) : NULL;
+        bool candidate = b && b >= mem && b < mem + bytes && !e->pins;
+        portEXIT_CRITICAL(&movable_lock);
+        if (!candidate) continue;   // ไม่อยู่ใน slab นี้ หรือเพิ่งถูก lock: slab จะยังไม่ว่าง, รอบหน้าค่อยลองใหม่
+
+        /* หาช่องปลายทางนอก slab: ช่องว่างของ slab เองพักไว้แล้วคืนทีหลัง */
+        memory_block_t* dst = NULL;
+        while (stashed < POOL_COMPACT_STASH) {
+            memory_block_t* cand = pool_pop_free(pool);
+            if (!cand) break;
+            if ((uint8_t*)cand < mem || (uint8_t*)cand >= mem + bytes) { dst = cand; break; }
+            stash[stashed++] = cand;
+        }
+        if (!dst) break;
+
+        xEventGroupClearBits(movable_events, MOVABLE_MOVED_BIT(i));
+        void* src = NULL;
+        portENTER_CRITICAL(&movable_lock);
+        b = e->pool == pool ? (uint8_t*)user_to_block(pool, e->ptr) : NULL;
+        if (b && b >= mem && b < mem + bytes && !e->pins) {
+            e->moving = true;
+            src = e->ptr;
+        }
+        portEXIT_CRITICAL(&movable_lock);
+        if (!src) {
+            /* ถูก lock/free ระหว่างหาปลายทาง */
+            xEventGroupSetBits(movable_events, MOVABLE_MOVED_BIT(i));
+            pool_push_free(pool, dst);
+            continue;
+        }
+        block_mark(pool, dst, POOL_MAGIC_ALLOC, POOL_TIME_NOW());
+        moves[n].slot = i;
+        moves[n].src = src;
+        moves[n].dst = dst;
+        n++;
+    }
+    xSemaphoreGive(pool->mutex);
+
+    for (size_t m = 0; m < n; m++) {
+        void* moved = block_to_user(pool, moves[m].dst);
+        memcpy(moved, moves[m].src, pool->block_size);
+        portENTER_CRITICAL(&movable_lock);
+        movable_table[moves[m].slot].ptr = moved;
+        movable_table[moves[m].slot].moving = false;
+        portEXIT_CRITICAL(&movable_lock);
+        xEventGroupSetBits(movable_events, MOVABLE_MOVED_BIT(moves[m].slot));
+    }
+
+    xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    for (size_t m = 0; m < n; m++) {
+        memory_block_t* src = user_to_block(pool, moves[m].src);
+        block_retire(pool, src);
+        pool_push_free(pool, src);
+    }
+    while (stashed) pool_push_free(pool, stash[--stashed]);
+    if (pool_release_slab(pool, k, esp_timer_get_time(), 0)) released = 1;
+    xSemaphoreGive(pool->mutex);
+
+    st.passes = 1;
+    st.blocks_moved = n;
+    st.bytes_moved = (uint64_t)n * pool->block_size;
+    st.slabs_released = released;
+    st.time_us = esp_timer_get_time() - t0;
+
+done:
+    portENTER_CRITICAL(&movable_lock);
+    compaction_stats.passes         += st.passes;
+    compaction_stats.blocks_moved   += st.blocks_moved;
+    compaction_stats.bytes_moved    += st.bytes_moved;
+    compaction_stats.time_us        += st.time_us;
+    compaction_stats.slabs_released += st.slabs_released;
+    compaction_stats.skipped_pinned += st.skipped_pinned;
+    compaction_stats.skipped_unmovable += st.skipped_unmovable;
+    portEXIT_CRITICAL(&movable_lock);
+#else
+    (void)pool;
+#endif
+    if (out) *out = st;
+    return released;
+}
+
+static void print_compaction_stats(void)
+{
+#if POOL_COMPACT_ENABLED
+    portENTER_CRITICAL(&movable_lock);
+    const pool_compaction_stats_t st = compaction_stats;
+    portEXIT_CRITICAL(&movable_lock);
+    if (!st.passes) return;
+    ESP_LOGI(TAG, "🧲 compaction: %u passes, moved %u blocks (%llu B) in %llu us, released %u slabs, "
+                  "skipped %u pinned / %u with non-movable blocks",
+             (unsigned)st.passes, (unsigned)st.blocks_moved, st.bytes_moved, st.time_us,
+             (unsigned)st.slabs_released, (unsigned)st.skipped_pinned, (unsigned)st.skipped_unmovable);
+#endif
+}
+
+/* ---------------- ISR-safe Allocation/Free ----------------
+   ไม่มี mutex/log: ใช้แค่ spinlock ของพูล และ helper ใน IRAM ที่เป็น O(1) ล้วน
+   (หัว free list/LF stack หนึ่งตัว + bitmap) จึงมี worst case จำกัด; เวลาที่วัดได้จริงเก็บไว้เป็น cycles
+   ISR ไม่ carve และไม่ scan bitmap: พูลที่ ISR ใช้ต้องผ่าน pool_prepare_isr() ก่อน
+   (BITMAP strategy หรือบล็อกที่ยังอยู่หลัง bump index -> จองจาก ISR ไม่ได้ นับเป็น failure) */
+static void pool_prepare_isr(memory_pool_t* pool)
+{
+    if (!pool->mutex) return;
+    xSemaphoreTake(pool->mutex, portMAX_DELAY);
+    size_t carved = 0;
+    for (;;) {
+        /* carve ทีละบล็อก ไม่ถือ spinlock ยาวทั้งพูล */
+        portENTER_CRITICAL(&pool->lock);
+        bool done = pool->carve_next >= pool->base_block_count;
+        if (!done) {
+            size_t idx = pool->carve_next;
+            memory_block_t* blk = pool_block_at(pool, idx);
+            pool_carve_upto(pool, idx + 1);
+            if (pool->strategy == POOL_STRATEGY_FREELIST) {
+                blk->next = pool->free_list;
+                pool->free_list = blk;
+            }
+        }
+        portEXIT_CRITICAL(&pool->lock);
+        if (done) break;
+        carved++;
+    }
+    xSemaphoreGive(pool->mutex);
+    ESP_LOGI(TAG, "%s: pre-carved %u blocks for ISR use", pool->name, (unsigned)carved);
+}
+
+static void* IRAM_ATTR pool_malloc_from_isr(memory_pool_t* pool)
+{
+    if (!pool || !pool->pool_memory) return NULL;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    memory_block_t* corrupt = NULL;
+    void* out = NULL;
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        memory_block_t* blk = pool_lf_pop(pool);
+        if (blk && POOL_VERIFY(block_is(pool, blk, POOL_MAGIC_FREE))) {
+            block_mark(pool, blk, POOL_MAGIC_ALLOC, 0);
+            pool->isr_allocations++;
+            out = block_to_user(pool, blk);
+        } else {
+            if (blk) gpio_set_level(LED_POOL_ERROR, 1);
+            __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+        }
+        uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+        if (cycles > pool->isr_alloc_max_cycles) pool->isr_alloc_max_cycles = cycles;
+        return out;
+    }
+
+    portENTER_CRITICAL_ISR(&pool->lock);
+    memory_block_t* blk = (pool->strategy == POOL_STRATEGY_FREELIST) ? pool_pop_list(pool, &corrupt) : NULL;
+    if (blk) {
+        pool_account_pop(pool, blk);
+        block_mark(pool, blk, POOL_MAGIC_ALLOC, 0);   // ไม่อ่าน esp_timer ใน ISR
+        pool->isr_allocations++;
+        out = block_to_user(pool, blk);
+    } else {
+        __atomic_fetch_add(&pool->allocation_failures, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+    if (cycles > pool->isr_alloc_max_cycles) pool->isr_alloc_max_cycles = cycles;
+    portEXIT_CRITICAL_ISR(&pool->lock);
+
+    if (corrupt) gpio_set_level(LED_POOL_ERROR, 1);
+    return out;
+}
+
+static bool IRAM_ATTR pool_free_from_isr(memory_pool_t* pool, void* ptr)
+{
+    if (!pool || !ptr || !pool->pool_memory) return false;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    memory_block_t* blk = user_to_block(pool, ptr);
+
+    if (pool->strategy == POOL_STRATEGY_LOCKFREE) {
+        if (!POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk))) {
+            gpio_set_level(LED_POOL_ERROR, 1);
+            return false;
+        }
+        block_retire(pool, blk);
+        pool_lf_push(pool, blk);
+        pool->isr_deallocations++;
+        uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+        if (cycles > pool->isr_free_max_cycles) pool->isr_free_max_cycles = cycles;
+        return true;
+    }
+
+    /* ตรวจภายใต้ spinlock: task/ISR อีกฝั่งจะ free บล็อกเดียวกันแทรกระหว่างตรวจกับ push ไม่ได้ */
+    portENTER_CRITICAL_ISR(&pool->lock);
+    bool ok = POOL_VERIFY(pool_owns_block(pool, blk) && block_claim(pool, blk));
+    if (ok) {
+        block_retire(pool, blk);
+        pool_push_raw(pool, blk);
+        pool->isr_deallocations++;
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+    if (cycles > pool->isr_free_max_cycles) pool->isr_free_max_cycles = cycles;
+    portEXIT_CRITICAL_ISR(&pool->lock);
+
+    if (!ok) gpio_set_level(LED_POOL_ERROR, 1);
+    return ok;
+}
+
+/* ---------------- Smart API ---------------- */
+/* ---------------- Allocation-size profiling ----------------
+   นับคำขอของ smart_pool_malloc ตามคลาสขนาด (need = size + headroom) พร้อมจำนวนที่ค้างพร้อมกันสูงสุด
+   pointer -> คลาส เก็บใน hash table เล็ก ๆ (linear probing, ลบแบบ backward shift) เพื่อให้ตอน free
+   ลด live ของคลาสที่ถูกต้องได้ ทั้งบล็อกจากพูลและจาก heap fallback
+   spinlock กลาง + probe ต่อ alloc/free แพงเกินกว่าจะเปิดทิ้งไว้: ปิดไว้ตอนคอมไพล์โดยปริยาย
+   ถ้าเปิด จะเก็บแค่ช่วงแรกหนึ่งรอบของ monitor แล้วปิดตัวเอง (active ถูกเช็คก่อนแตะ lock) */
+#define POOL_PROFILE_ENABLED             0
+#define POOL_PROFILE_TRACK_BITS          8       // 256 live pointers
+#define POOL_PROFILE_TRACK_SLOTS         (1u << POOL_PROFILE_TRACK_BITS)
+#define POOL_PROFILE_TARGET_MISS_PERMILLE 10     // ยอมให้ 1% ของคำขอตกไป heap
+
+typedef struct {
+    void* ptr;               // NULL = empty
+    uint8_t cls;
+} pool_profile_slot_t;
+
+static struct {
+    uint32_t requests[SIZE_CLASS_COUNT];
+    uint16_t live[SIZE_CLASS_COUNT];
+    uint16_t peak[SIZE_CLASS_COUNT];
+    uint32_t oversize;       // ใหญ่กว่าทุกคลาส -> heap เสมอ
+    uint32_t untracked;      // track table เต็ม (peak อาจต่ำกว่าจริง)
+    pool_profile_slot_t track[POOL_PROFILE_TRACK_SLOTS];
+    volatile bool active;    // false = smart alloc/free ไม่แตะ lock/table เลย
+    portMUX_TYPE lock;
+} pool_profile = { .active = POOL_PROFILE_ENABLED, .lock = portMUX_INITIALIZER_UNLOCKED };
+
+static inline uint32_t pool_profile_hash(const void* ptr) {
+    return ((uint32_t)(uintptr_t)ptr * 2654435761u) >> (32 - POOL_PROFILE_TRACK_BITS);
+}
+
+static void pool_profile_on_alloc(void* ptr, int cls)
+{
+#if POOL_PROFILE_ENABLED
+    if (!ptr || !pool_profile.active) return;
+    portENTER_CRITICAL(&pool_profile.lock);
+    if (cls < 0) {
+        pool_profile.oversize++;
+    } else {
+        pool_profile.requests[cls]++;
+        uint32_t i = pool_profile_hash(ptr), n = 0;
+        while (pool_profile.track[i].ptr && n < POOL_PROFILE_TRACK_SLOTS) {
+            i = (i + 1) & (POOL_PROFILE_TRACK_SLOTS - 1);
+            n++;
+        }
+        if (n < POOL_PROFILE_TRACK_SLOTS) {
+            pool_profile.track[i] = (pool_profile_slot_t){ ptr, (uint8_t)cls };
+            if (++pool_profile.live[cls] > pool_profile.peak[cls]) pool_profile.peak[cls] = pool_profile.live[cls];
+        } else {
+            pool_profile.untracked++;
+        }
+    }
+    portEXIT_CRITICAL(&pool_profile.lock);
+#endif
+}
+
+static void pool_profile_on_free(void* ptr)
+{
+#if POOL_PROFILE_ENABLED
+    if (!pool_profile.active) return;
+    portENTER_CRITICAL(&pool_profile.lock);
+    uint32_t i = pool_profile_hash(ptr);
+    for (uint32_t n = 0; n < POOL_PROFILE_TRACK_SLOTS && pool_profile.track[i].ptr; n++) {
+        if (pool_profile.track[i].ptr == ptr) {
+            pool_profile.live[pool_profile.track[i].cls]--;
+            /* backward shift: ดึงตัวที่ probe ผ่านช่องนี้มาเติม ไม่ต้องใช้ tombstone */
+            uint32_t hole = i;
+            for (uint32_t j = (i + 1) & (POOL_PROFILE_TRACK_SLOTS - 1); pool_profile.track[j].ptr;
+                 j = (j + 1) & (POOL_PROFILE_TRACK_SLOTS - 1)) {
+                uint32_t home = pool_profile_hash(pool_profile.track[j].ptr);
+                if (((j - home) & (POOL_PROFILE_TRACK_SLOTS - 1)) >= ((j - hole) & (POOL_PROFILE_TRACK_SLOTS - 1))) {
+                    pool_profile.track[hole] = pool_profile.track[j];
+                    hole = j;
+                }
+            }
+            pool_profile.track[hole].ptr = NULL;
+            break;
+        }
+        i = (i + 1) & (POOL_PROFILE_TRACK_SLOTS - 1);
+    }
+    portEXIT_CRITICAL(&pool_profile.lock);
+#endif
+}
+
+/* size class -> พูลแรกที่ใส่ได้ ถ้าเต็มไล่ไปพูลใหญ่กว่า; NULL = ทุกพูลไม่ได้
+   พูลที่ alignment ไม่พอ = หยุด (ให้ผู้เรียกไป heap แบบ aligned) ไม่ไต่ขึ้นพูลใหญ่เพื่อ alignment
+   ไม่งั้น node 8-byte aligned ขนาด 24 ไบต์จะไปกิน block 4 KB ของ Huge */
+static void* smart_pool_take(size_t size, size_t align, int* pool_out)
+{
+    size_t need = size + SMART_POOL_HEADROOM;
+    int cls = size_class_index(need);
+    for (int i = (cls < 0) ? POOL_GENERAL_COUNT : size_classes[cls].pool; i < POOL_GENERAL_COUNT; i++) {
+        if (pools[i].alignment < align) break;
+        if (need <= pools[i].block_size) {
+            void* p = pool_malloc(&pools[i]);
+            if (p) {
+                size_class_stats.requests++;
+                size_class_stats.requested_bytes  += size;
+                size_class_stats.pool_block_bytes += pools[i].block_size;
+                size_class_stats.class_bytes      += size_classes[cls].bytes;
+                pool_profile_on_alloc(p, cls);
+                *pool_out = i;
+                return p;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* smart_pool_malloc(size_t size)
+{
+    int i;
+    void* p = smart_pool_take(size, 0, &i);
+    if (p) {
+        /* LED pulse: fire-and-forget, ไม่บล็อกผู้จอง */
+        indicator_pulse((i==POOL_SMALL)?LED_SMALL_POOL:(i==POOL_MEDIUM)?LED_MEDIUM_POOL:LED_LARGE_POOL, 30);
+        return p;
+    }
+    ESP_LOGW(TAG, "no suitable pool for %uB -> fallback heap", (unsigned)size);
+    p = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+    pool_profile_on_alloc(p, size_class_index(size + SMART_POOL_HEADROOM));
+    return p;
+}
+
+static bool smart_pool_free(void* ptr)
+{
+    if (!ptr) return false;
+    pool_profile_on_free(ptr);
+    memory_pool_t* pool = pool_index_lookup(ptr);
+    if (pool) return pool_free(pool, ptr);
+    heap_caps_free(ptr); // fallback
+    return true;
+}
+
+/* ---------------- Public C API (memory_pools.h) ----------------
+   เส้นทางเดียวกับ smart_pool_malloc แต่ไม่มี LED/log: ใช้เป็น backend ของ PoolAllocator<T> ในฝั่ง C++ */
+void* memory_pool_alloc(size_t size, size_t align)
+{
+    int i;
+    if (align < POOL_DEFAULT_ALIGNMENT) align = POOL_DEFAULT_ALIGNMENT;
+    void* p = smart_pool_take(size, align, &i);
+    if (p) return p;
+    p = (align > POOL_DEFAULT_ALIGNMENT) ? heap_caps_aligned_alloc(align, size, MALLOC_CAP_DEFAULT)
+                                         : heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+    pool_profile_on_alloc(p, size_class_index(size + SMART_POOL_HEADROOM));
+    return p;
+}
+
+void memory_pool_free(void* ptr)
+{
+    smart_pool_free(ptr);
+}
+
+const char* memory_pool_owner_name(const void* ptr)
+{
+    memory_pool_t* pool = pool_index_lookup(ptr);
+    return pool ? pool->name : "heap";
+}
+
+/* ---------------- Static FreeRTOS object factory ----------------
+   control block ของ queue/semaphore/timer/event group และ storage ของ queue มาจากพูลเฉพาะ
+   ที่จองไว้ตอนบูต (ไม่โต) แล้วสร้างด้วย *CreateStatic: สร้าง/ลบเป็น O(1) และไม่แตะ heap หลังบูต
+   handle ของ object แบบ static คือ address ของ control block เอง จึงคืนบล็อกได้ตรง ๆ */
+#define RTOS_QUEUE_COUNT          8
+#define RTOS_QUEUE_STORAGE_BYTES  256   // len × item_size สูงสุดต่อคิว
+#define RTOS_SEMAPHORE_COUNT      16
+#define RTOS_TIMER_COUNT          8
+#define RTOS_EVENT_GROUP_COUNT    8
+
+typedef enum {
+    RTOS_POOL_QUEUE = 0,
+    RTOS_POOL_QUEUE_STORAGE,
+    RTOS_POOL_SEMAPHORE,
+    RTOS_POOL_TIMER,
+    RTOS_POOL_EVENT_GROUP,
+    RTOS_POOL_COUNT
+} rtos_pool_type_t;
+
+static memory_pool_t rtos_pools[RTOS_POOL_COUNT];
+static uint8_t** rtos_queue_storage;   // per queue control block index
+
+bool rtos_factory_init(void)
+{
+    const pool_config_t cfgs[RTOS_POOL_COUNT] = {
+        { "RtosQueue",   sizeof(StaticQueue_t),      RTOS_QUEUE_COUNT,       0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 },
+        { "RtosQStore",  RTOS_QUEUE_STORAGE_BYTES,   RTOS_QUEUE_COUNT,       0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 },
+        { "RtosSem",     sizeof(StaticSemaphore_t),  RTOS_SEMAPHORE_COUNT,   0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 },
+        { "RtosTimer",   sizeof(StaticTimer_t),      RTOS_TIMER_COUNT,       0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 },
+        { "RtosEvGroup", sizeof(StaticEventGroup_t), RTOS_EVENT_GROUP_COUNT, 0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 },
+    };
+    for (int k = 0; k < RTOS_POOL_COUNT; k++) {
+        /* pool_id ต่อจาก lf_bench_pool (POOL_COUNT + 1) */
+        if (!try_init_pool(&rtos_pools[k], &cfgs[k], POOL_COUNT + 2 + k, cfgs[k].block_count)) return false;
+    }
+    rtos_queue_storage = (uint8_t**) heap_caps_calloc(rtos_pools[RTOS_POOL_QUEUE].block_count,
+                                                      sizeof(uint8_t*), MALLOC_CAP_INTERNAL);
+    return rtos_queue_storage != NULL;
+}
+
+static inline void* rtos_take(rtos_pool_type_t t) {
+    return rtos_pools[t].mutex ? pool_malloc(&rtos_pools[t]) : NULL;
+}
+
+static inline void rtos_give(rtos_pool_type_t t, void* p) {
+    if (p) pool_free(&rtos_pools[t], p);
+}
+
+static inline size_t rtos_queue_slot(const void* cb) {
+    memory_pool_t* pool = &rtos_pools[RTOS_POOL_QUEUE];
+    return pool_block_index(pool, user_to_block(pool, (void*)cb));
+}
+
+QueueHandle_t rtos_queue_create(UBaseType_t length, UBaseType_t item_size)
+{
+    size_t bytes = (size_t)length * item_size;
+    if (bytes > rtos_pools[RTOS_POOL_QUEUE_STORAGE].block_size) {
+        ESP_LOGW(TAG, "rtos_queue_create: %uB storage > %uB block", (unsigned)bytes,
+                 (unsigned)rtos_pools[RTOS_POOL_QUEUE_STORAGE].block_size);
+        return NULL;
+    }
+    StaticQueue_t* cb = (StaticQueue_t*) rtos_take(RTOS_POOL_QUEUE);
+    if (!cb) return NULL;
+    uint8_t* storage = NULL;
+    if (bytes && !(storage = (uint8_t*) rtos_take(RTOS_POOL_QUEUE_STORAGE))) {
+        rtos_give(RTOS_POOL_QUEUE, cb);
+        return NULL;
+    }
+    rtos_queue_storage[rtos_queue_slot(cb)] = storage;
+    return xQueueCreateStatic(length, item_size, storage, cb);
+}
+
+void rtos_queue_delete(QueueHandle_t queue)
+{
+    if (!queue) return;
+    vQueueDelete(queue);
+    size_t slot = rtos_queue_slot(queue);
+    rtos_give(RTOS_POOL_QUEUE_STORAGE, rtos_queue_storage[slot]);
+    rtos_queue_storage[slot] = NULL;
+    rtos_give(RTOS_POOL_QUEUE, queue);
+}
+
+SemaphoreHandle_t rtos_mutex_create(void)
 {
-    size_t count = cfg->block_count;
-    while (count >= 1) {
-        if (try_init_pool(pool, cfg, pool_id, count)) return true;
-        count /= 2;
-        ESP_LOGW(TAG, "%s: retry with smaller block_count = %u", cfg->name, (unsigned)count);
-    }
-    return false;
+    StaticSemaphore_t* cb = (StaticSemaphore_t*) rtos_take(RTOS_POOL_SEMAPHORE);
+    return cb ? xSemaphoreCreateMutexStatic(cb) : NULL;
 }
 
-/* ---------------- Allocation/Free ---------------- */
-static void* pool_malloc(memory_pool_t* pool)
+SemaphoreHandle_t rtos_binary_semaphore_create(void)
 {
-    if (!pool || !pool->mutex) return NULL;
-    uint64_t t0 = esp_timer_get_time();
-    void* out = NULL;
-
-    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-        if (pool->free_list) {
-            memory_block_t* blk = pool->free_list;
-            pool->free_list = blk->next;
+    StaticSemaphore_t* cb = (StaticSemaphore_t*) rtos_take(RTOS_POOL_SEMAPHORE);
+    return cb ? xSemaphoreCreateBinaryStatic(cb) : NULL;
+}
 
-            if (blk->magic != POOL_MAGIC_FREE || blk->pool_id != pool->pool_id) {
-                ESP_LOGE(TAG, "🚨 %s: corruption on alloc blk=%p", pool->name, blk);
-                gpio_set_level(LED_POOL_ERROR, 1);
-                xSemaphoreGive(pool->mutex);
-                return NULL;
-            }
+SemaphoreHandle_t rtos_counting_semaphore_create(UBaseType_t max_count, UBaseType_t initial)
+{
+    StaticSemaphore_t* cb = (StaticSemaphore_t*) rtos_take(RTOS_POOL_SEMAPHORE);
+    return cb ? xSemaphoreCreateCountingStatic(max_count, initial, cb) : NULL;
+}
 
-            blk->magic = POOL_MAGIC_ALLOC;
-            blk->alloc_time = esp_timer_get_time();
-            blk->next = NULL;
+void rtos_semaphore_delete(SemaphoreHandle_t sem)
+{
+    if (!sem) return;
+    vSemaphoreDelete(sem);
+    rtos_give(RTOS_POOL_SEMAPHORE, sem);
+}
 
-            pool->allocated_blocks++;
-            if (pool->allocated_blocks > pool->peak_usage) pool->peak_usage = pool->allocated_blocks;
-            pool->total_allocations++;
+TimerHandle_t rtos_timer_create(const char* name, TickType_t period, UBaseType_t auto_reload,
+                                void* timer_id, TimerCallbackFunction_t callback)
+{
+    StaticTimer_t* cb = (StaticTimer_t*) rtos_take(RTOS_POOL_TIMER);
+    return cb ? xTimerCreateStatic(name, period, auto_reload, timer_id, callback, cb) : NULL;
+}
 
-            /* set bitmap */
-            const size_t stride = sizeof(memory_block_t) + aligned_size(pool->block_size, pool->alignment);
-            size_t idx = ((uint8_t*)blk - (uint8_t*)pool->pool_memory) / stride;
-            if (idx < pool->block_count) pool->usage_bitmap[idx >> 3] |= (uint8_t)(1u << (idx & 7));
+/* รันใน timer daemon task หลังคำสั่ง delete ของ timer เดียวกัน (คิวคำสั่งเป็น FIFO) */
+static void rtos_timer_release(void* control_block, uint32_t unused)
+{
+    (void)unused;
+    rtos_give(RTOS_POOL_TIMER, control_block);
+}
 
-            out = (uint8_t*)blk + sizeof(memory_block_t);
-        } else {
-            pool->allocation_failures++;
-            gpio_set_level(LED_POOL_FULL, 1);
-            ESP_LOGW(TAG, "🔴 %s: pool exhausted %u/%u", pool->name,
-                     (unsigned)pool->allocated_blocks, (unsigned)pool->block_count);
-        }
-        xSemaphoreGive(pool->mutex);
+bool rtos_timer_delete(TimerHandle_t timer, TickType_t wait)
+{
+    if (!timer) return false;
+    /* xTimerDelete แค่ส่งคำสั่งให้ daemon — คืนบล็อกทันทีไม่ได้ ไม่งั้น daemon ยังแตะ control block ที่ถูกใช้ซ้ำ */
+    if (xTimerDelete(timer, wait) != pdPASS) return false;
+    if (xTimerPendFunctionCall(rtos_timer_release, timer, 0, wait) != pdPASS) {
+        ESP_LOGE(TAG, "🚨 rtos_timer_delete: release not queued, control block %p leaked", timer);
+        return false;
     }
-
-    pool->allocation_time_total += (esp_timer_get_time() - t0);
-    return out;
+    return true;
 }
 
-static bool pool_free(memory_pool_t* pool, void* ptr)
+EventGroupHandle_t rtos_event_group_create(void)
 {
-    if (!pool || !ptr || !pool->mutex) return false;
-    uint64_t t0 = esp_timer_get_time();
-    bool ok = false;
+    StaticEventGroup_t* cb = (StaticEventGroup_t*) rtos_take(RTOS_POOL_EVENT_GROUP);
+    return cb ? xEventGroupCreateStatic(cb) : NULL;
+}
 
-    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-        memory_block_t* blk = (memory_block_t*)((uint8_t*)ptr - sizeof(memory_block_t));
+void rtos_event_group_delete(EventGroupHandle_t group)
+{
+    if (!group) return;
+    vEventGroupDelete(group);
+    rtos_give(RTOS_POOL_EVENT_GROUP, group);
+}
 
-        /* verify bounds */
-        const size_t stride = sizeof(memory_block_t) + aligned_size(pool->block_size, pool->alignment);
-        uint8_t* start = (uint8_t*)pool->pool_memory;
-        uint8_t* end   = start + stride * pool->block_count;
-
-        if ((uint8_t*)blk < start || (uint8_t*)blk >= end ||
-            blk->magic != POOL_MAGIC_ALLOC || blk->pool_id != pool->pool_id) {
-            ESP_LOGE(TAG, "🚨 invalid free %p for %s (magic=0x%08X pid=%lu)",
-                     ptr, pool->name, blk->magic, blk->pool_id);
-            gpio_set_level(LED_POOL_ERROR, 1);
-        } else {
-            size_t idx = ((uint8_t*)blk - start) / stride;
-            pool->usage_bitmap[idx >> 3] &= (uint8_t)~(1u << (idx & 7));
-            blk->magic = POOL_MAGIC_FREE;
-            blk->next = pool->free_list;
-            pool->free_list = blk;
-
-            if (pool->allocated_blocks) pool->allocated_blocks--;
-            pool->total_deallocations++;
-            ok = true;
-        }
-        xSemaphoreGive(pool->mutex);
+/* บัฟเฟอร์ที่ DMA ใช้ได้และตรง DMA_POOL_ALIGNMENT เสมอ; ใหญ่เกินบล็อก/พูลหมด -> heap แบบ aligned
+   คืนด้วย smart_pool_free ได้เหมือนกัน */
+static void* dma_pool_malloc(size_t size)
+{
+    memory_pool_t* pool = &pools[POOL_DMA];
+    if (size <= pool->block_size) {
+        void* p = pool_malloc(pool);
+        if (p) return p;
     }
-
-    pool->deallocation_time_total += (esp_timer_get_time() - t0);
-    return ok;
+    ESP_LOGW(TAG, "DMA pool miss for %uB -> fallback heap", (unsigned)size);
+    return heap_caps_aligned_alloc(DMA_POOL_ALIGNMENT, size, MALLOC_CAP_DMA);
 }
 
-/* ---------------- Smart API ---------------- */
-static void* smart_pool_malloc(size_t size)
+/* ---------------- Monitoring ---------------- */
+static void print_pool_latency(const memory_pool_t* p, const char* what, const pool_latency_hist_t* h)
 {
-    size_t need = size + 16; // headroom
-    for (int i = 0; i < POOL_COUNT; i++) {
-        if (need <= pools[i].block_size) {
-            void* p = pool_malloc(&pools[i]);
-            if (p) {
-                /* LED pulse */
-                gpio_set_level((i==POOL_SMALL)?LED_SMALL_POOL:(i==POOL_MEDIUM)?LED_MEDIUM_POOL:LED_LARGE_POOL, 1);
-                vTaskDelay(pdMS_TO_TICKS(30));
-                gpio_set_level((i==POOL_SMALL)?LED_SMALL_POOL:(i==POOL_MEDIUM)?LED_MEDIUM_POOL:LED_LARGE_POOL, 0);
-                return p;
-            }
-        }
-    }
-    ESP_LOGW(TAG, "no suitable pool for %uB -> fallback heap", (unsigned)size);
-    return heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+    uint32_t n = 0;
+    for (int b = 0; b < POOL_LAT_BUCKETS; b++) n += h->buckets[b];
+    if (!n) return;
+    const double mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    ESP_LOGI(TAG, "%s: %s n=%u p50 ≤%.2f us p99 ≤%.2f us max %.2f us",
+             p->name, what, (unsigned)n,
+             pool_latency_percentile(h, 50) / mhz,
+             pool_latency_percentile(h, 99) / mhz,
+             h->max_cycles / mhz);
 }
 
-static bool smart_pool_free(void* ptr)
+/* อ่านสถิติแบบไม่ block: กลุ่ม seqlock อ่านซ้ำจนได้ชุดที่ไม่มี writer แทรก, ที่เหลือเป็น atomic load */
+static void pool_stats_snapshot(const memory_pool_t* p, pool_stats_t* st)
 {
-    if (!ptr) return false;
-    for (int i = 0; i < POOL_COUNT; i++) {
-        if (pool_free(&pools[i], ptr)) return true;
+    uint32_t seq;
+    do {
+        seq = p->stats_seq;
+        __sync_synchronize();
+        st->block_count  = p->block_count;
+        st->allocated    = p->allocated_blocks;
+        st->peak         = p->peak_usage;
+        st->slab_grows   = p->slab_grows;
+        st->slab_shrinks = p->slab_shrinks;
+        st->live_slabs   = 0;
+        for (int k = 0; k < (int)p->max_slabs; k++) if (p->slabs[k].memory) st->live_slabs++;
+        __sync_synchronize();
+    } while ((seq & 1) || seq != p->stats_seq);
+
+    st->allocs   = __atomic_load_n(&p->total_allocations, __ATOMIC_RELAXED);
+    st->frees    = __atomic_load_n(&p->total_deallocations, __ATOMIC_RELAXED);
+    st->failures = __atomic_load_n(&p->allocation_failures, __ATOMIC_RELAXED);
+    st->cached = 0;
+    st->refills = st->flushes = 0;
+    st->remote_frees = st->remote_reclaims = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        const pool_magazine_t* m = &p->magazines[c];
+        st->allocs  += __atomic_load_n(&m->allocs, __ATOMIC_RELAXED);
+        st->frees   += __atomic_load_n(&m->frees, __ATOMIC_RELAXED);
+        st->refills += __atomic_load_n(&m->refills, __ATOMIC_RELAXED);
+        st->flushes += __atomic_load_n(&m->flushes, __ATOMIC_RELAXED);
+        st->cached  += __atomic_load_n(&m->count, __ATOMIC_RELAXED) +
+                       __atomic_load_n(&m->remote_count, __ATOMIC_RELAXED);
+        st->remote_frees    += __atomic_load_n(&m->remote_frees, __ATOMIC_RELAXED);
+        st->remote_reclaims += __atomic_load_n(&m->remote_reclaims, __ATOMIC_RELAXED);
     }
-    heap_caps_free(ptr); // fallback
-    return true;
+    st->frees += st->remote_frees;
+    st->mutex_acquisitions = __atomic_load_n(&p->mutex_acquisitions, __ATOMIC_RELAXED);
+    st->in_use = (st->allocated > st->cached) ? st->allocated - st->cached : 0;
 }
 
-/* ---------------- Monitoring ---------------- */
 static void print_pool_statistics(void)
 {
     ESP_LOGI(TAG, "\n📊 POOL STATS");
     for (int i = 0; i < POOL_COUNT; i++) {
         memory_pool_t* p = &pools[i];
         if (!p->mutex) continue;
-        if (xSemaphoreTake(p->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            ESP_LOGI(TAG, "%s: used %u/%u (peak %u) fail %u alloc %llu free %llu",
+        pool_stats_t st;
+        pool_stats_snapshot(p, &st);
+        ESP_LOGI(TAG, "%s: used %u/%u (peak %u) fail %u alloc %llu free %llu",
+                 p->name,
+                 (unsigned)st.in_use, (unsigned)st.block_count,
+                 (unsigned)st.peak, (unsigned)st.failures,
+                 st.allocs, st.frees);
+        ESP_LOGI(TAG, "%s: magazine cached %u refills %u flushes %u | remote free %u reclaim %u | mutex %u",
+                 p->name, (unsigned)st.cached,
+                 (unsigned)st.refills, (unsigned)st.flushes,
+                 (unsigned)st.remote_frees, (unsigned)st.remote_reclaims,
+                 (unsigned)st.mutex_acquisitions);
+        if (p->max_slabs) {
+            ESP_LOGI(TAG, "%s: slabs %u/%u live (%u blocks each) grow %u shrink %u",
+                     p->name, (unsigned)st.live_slabs, (unsigned)p->max_slabs, (unsigned)p->slab_blocks,
+                     (unsigned)st.slab_grows, (unsigned)st.slab_shrinks);
+        }
+        print_pool_latency(p, "alloc", &p->alloc_latency);
+        print_pool_latency(p, "free",  &p->free_latency);
+        print_pool_latency(p, "mutex wait", &p->mutex_wait);
+        if (p->debug_violations) {
+            ESP_LOGE(TAG, "🚨 %s: %u poison/canary violations (use-after-free or overrun)",
+                     p->name, (unsigned)p->debug_violations);
+            gpio_set_level(LED_POOL_ERROR, 1);
+        }
+        if (p->isr_allocations || p->isr_deallocations) {
+            ESP_LOGI(TAG, "%s: ISR alloc %u (worst %.2f us) free %u (worst %.2f us)",
                      p->name,
-                     (unsigned)p->allocated_blocks, (unsigned)p->block_count,
-                     (unsigned)p->peak_usage, (unsigned)p->allocation_failures,
-                     p->total_allocations, p->total_deallocations);
-            xSemaphoreGive(p->mutex);
+                     (unsigned)p->isr_allocations,
+                     (double)p->isr_alloc_max_cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+                     (unsigned)p->isr_deallocations,
+                     (double)p->isr_free_max_cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+        }
+    }
+}
+
+static void print_size_class_report(void)
+{
+    uint64_t req = size_class_stats.requested_bytes;
+    if (!size_class_stats.requests || !req) return;
+    uint64_t pool_waste  = size_class_stats.pool_block_bytes - req;
+    uint64_t class_waste = size_class_stats.class_bytes - req;
+    ESP_LOGI(TAG, "size classes: %u reqs, %lluB requested | actual 4-pool waste %lluB (%.1f%%) | "
+                  "projected waste with %d per-class pools (not built) %lluB (%.1f%%)",
+             (unsigned)size_class_stats.requests, req,
+             pool_waste,  100.0 * (double)pool_waste  / (double)size_class_stats.pool_block_bytes,
+             SIZE_CLASS_COUNT,
+             class_waste, 100.0 * (double)class_waste / (double)size_class_stats.class_bytes);
+}
+
+/* ---------------- Geometry derivation from the size profile ----------------
+   1) คลาสที่ "แพงต่อคำขอ" (bytes × peak / requests สูง) ถูกปล่อยให้ตก heap จนเต็มงบ miss
+   2) คลาสที่เหลือ (เรียงตามขนาด) ถูกแบ่งเป็นช่วงต่อเนื่อง ≤ POOL_COUNT ช่วงด้วย DP
+      ให้ Σ (ขนาดคลาสบนสุดของช่วง + header) × Σ peak ในช่วง น้อยที่สุด
+   peak รวมกันเป็นขอบบน (คลาสในช่วงเดียวกันอาจไม่ได้ค้างพร้อมกัน) จึงไม่ fail ในโหลดที่ profile เห็น */
+static size_t pool_profile_derive(pool_config_t out[POOL_GENERAL_COUNT], uint32_t* total_requests)
+{
+    static const char* const names[POOL_GENERAL_COUNT] = { "Small", "Medium", "Large", "Huge" };
+    static const gpio_num_t leds[POOL_GENERAL_COUNT] = { LED_SMALL_POOL, LED_MEDIUM_POOL, LED_LARGE_POOL, LED_POOL_FULL };
+    uint32_t req[SIZE_CLASS_COUNT];
+    uint16_t peak[SIZE_CLASS_COUNT];
+    bool keep[SIZE_CLASS_COUNT];
+    uint32_t total;
+
+    portENTER_CRITICAL(&pool_profile.lock);
+    memcpy(req, pool_profile.requests, sizeof(req));
+    memcpy(peak, pool_profile.peak, sizeof(peak));
+    total = pool_profile.oversize;
+    portEXIT_CRITICAL(&pool_profile.lock);
+
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++) { total += req[c]; keep[c] = req[c] > 0; }
+    *total_requests = total;
+
+    /* 1) ปล่อยคลาสแพงไป heap ภายในงบ miss (oversize นับเป็น miss อยู่แล้ว) */
+    int64_t budget = (int64_t)total * POOL_PROFILE_TARGET_MISS_PERMILLE / 1000 - pool_profile.oversize;
+    while (budget > 0) {
+        int worst = -1;
+        uint64_t worst_score = 0;
+        for (int c = 0; c < SIZE_CLASS_COUNT; c++) {
+            if (!keep[c] || req[c] > budget) continue;
+            uint64_t score = (uint64_t)size_classes[c].bytes * peak[c] / req[c];
+            if (score > worst_score) { worst_score = score; worst = c; }
+        }
+        if (worst < 0) break;
+        keep[worst] = false;
+        budget -= req[worst];
+    }
+
+    int kept[SIZE_CLASS_COUNT];
+    int m = 0;
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++) if (keep[c]) kept[m++] = c;
+    if (!m) return 0;
+
+    /* 2) DP: cost[j][g] = ต้นทุนต่ำสุดของ kept[0..j) ด้วย g พูล, cut = จุดเริ่มช่วงสุดท้าย */
+    static uint64_t cost[SIZE_CLASS_COUNT + 1][POOL_GENERAL_COUNT + 1];   // monitor task only; keep off its stack
+    static uint8_t cut[SIZE_CLASS_COUNT + 1][POOL_GENERAL_COUNT + 1];
+    for (int j = 0; j <= m; j++) for (int g = 0; g <= POOL_GENERAL_COUNT; g++) cost[j][g] = UINT64_MAX;
+    cost[0][0] = 0;
+    for (int g = 1; g <= POOL_GENERAL_COUNT; g++) {
+        for (int j = 1; j <= m; j++) {
+            uint64_t count = 0;
+            for (int i = j - 1; i >= 0; i--) {
+                count += peak[kept[i]];
+                if (cost[i][g - 1] == UINT64_MAX) continue;
+                uint64_t c = cost[i][g - 1] +
+                             (uint64_t)(size_classes[kept[j - 1]].bytes + sizeof(memory_block_t)) * count;
+                if (c < cost[j][g]) { cost[j][g] = c; cut[j][g] = (uint8_t)i; }
+            }
         }
     }
+    int groups = 1;
+    for (int g = 2; g <= POOL_GENERAL_COUNT; g++) if (cost[m][g] < cost[m][groups]) groups = g;
+
+    for (int g = groups, j = m; g > 0; g--) {
+        int i = cut[j][g];
+        size_t count = 0;
+        for (int k = i; k < j; k++) count += peak[kept[k]];
+        if (!count) count = 1;
+        size_t bytes = size_classes[kept[j - 1]].bytes;
+        out[g - 1] = (pool_config_t){
+            names[g - 1], bytes, count,
+            count * 2,                                   // slab headroom for load the profile did not see
+            bytes <= MEDIUM_POOL_BLOCK_SIZE ? MALLOC_CAP_INTERNAL : MALLOC_CAP_DEFAULT,
+            leds[g - 1],
+            bytes <= MEDIUM_POOL_BLOCK_SIZE,
+            POOL_DEFAULT_ALIGNMENT
+        };
+        j = i;
+    }
+    return (size_t)groups;
+}
+
+/* พิมพ์ผลเป็นตาราง pool_config_t ที่ copy กลับไปคอมไพล์ใน app_main ได้เลย */
+static void print_pool_profile(void)
+{
+#if POOL_PROFILE_ENABLED
+    if (!pool_profile.active) return;
+    /* หนึ่งรอบของ monitor พอสำหรับ derive: ปิดก่อนอ่าน ทางร้อนกลับไปไม่มี lock (ตัวนับหยุดนิ่งให้อ่าน) */
+    portENTER_CRITICAL(&pool_profile.lock);
+    pool_profile.active = false;
+    portEXIT_CRITICAL(&pool_profile.lock);
+
+    pool_config_t cfg[POOL_GENERAL_COUNT];
+    uint32_t total = 0;
+    size_t n = pool_profile_derive(cfg, &total);
+    if (!n) return;
+
+    size_t current = 0, derived = 0;
+    for (int i = 0; i < POOL_GENERAL_COUNT; i++) {
+        if (pools[i].mutex) current += pool_stride(&pools[i]) * pools[i].block_count;
+    }
+    for (size_t g = 0; g < n; g++) derived += (cfg[g].block_size + sizeof(memory_block_t)) * cfg[g].block_count;
+
+    ESP_LOGI(TAG, "📐 size profile: %u reqs (%u oversize, %u untracked), target miss %u‰ -> %uB vs current %uB",
+             (unsigned)total, (unsigned)pool_profile.oversize, (unsigned)pool_profile.untracked,
+             (unsigned)POOL_PROFILE_TARGET_MISS_PERMILLE, (unsigned)derived, (unsigned)current);
+    ESP_LOGI(TAG, "static const pool_config_t derived_pool_configs[%u] = {", (unsigned)n);
+    for (size_t g = 0; g < n; g++) {
+        ESP_LOGI(TAG, "    { \"%s\", %u, %u, %u, %s, %d, %s, %u },",
+                 cfg[g].name, (unsigned)cfg[g].block_size, (unsigned)cfg[g].block_count,
+                 (unsigned)cfg[g].max_block_count,
+                 cfg[g].caps == MALLOC_CAP_INTERNAL ? "MALLOC_CAP_INTERNAL" : "MALLOC_CAP_DEFAULT",
+                 (int)cfg[g].led_pin, cfg[g].external_meta ? "true" : "false",
+                 (unsigned)cfg[g].alignment);
+    }
+    ESP_LOGI(TAG, "};");
+#endif
 }
 
 static void visualize_pool_usage(void)
@@ -305,12 +2602,11 @@ static void visualize_pool_usage(void)
     for (int i = 0; i < POOL_COUNT; i++) {
         memory_pool_t* p = &pools[i];
         if (!p->mutex) continue;
-        if (xSemaphoreTake(p->mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-            int filled = (p->block_count==0) ? 0 : (int)( (p->allocated_blocks * 32) / p->block_count );
-            for (int j=0;j<32;j++) bar[j] = (j<filled)?'█':'░';
-            ESP_LOGI(TAG, "%s: [%s] %u/%u", p->name, bar, (unsigned)p->allocated_blocks, (unsigned)p->block_count);
-            xSemaphoreGive(p->mutex);
-        }
+        pool_stats_t st;
+        pool_stats_snapshot(p, &st);
+        int filled = (st.block_count==0) ? 0 : (int)( (st.in_use * 32) / st.block_count );
+        for (int j=0;j<32;j++) bar[j] = (j<filled)?'█':'░';
+        ESP_LOGI(TAG, "%s: [%s] %u/%u", p->name, bar, (unsigned)st.in_use, (unsigned)st.block_count);
     }
 }
 
@@ -319,12 +2615,34 @@ static void pool_monitor_task(void *arg)
 {
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(15000));
+
+        /* คืน slab ที่ว่างนานเกินกำหนด (magazine ถูกเทกลับก่อน ไม่งั้น slab ไม่มีวันว่างทั้งก้อน) */
+        for (int i = 0; i < POOL_COUNT; i++) {
+            memory_pool_t* p = &pools[i];
+            if (!p->mutex || !p->max_slabs) continue;
+            if (xSemaphoreTake(p->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+                pool_reclaim_magazines(p);
+                pool_release_idle_slabs(p, POOL_SLAB_IDLE_US);
+                xSemaphoreGive(p->mutex);
+            }
+        }
+        /* ย้าย movable block ออกจาก growth slab ของพูลใหญ่ แล้วคืน slab ที่ว่างทันที */
+        pool_compact(&pools[POOL_LARGE], NULL);
+        pool_compact(&pools[POOL_HUGE], NULL);
+
         print_pool_statistics();
+        print_size_class_report();
+        print_pool_profile();
+        print_compaction_stats();
+        indicator_stats_t ind;
+        indicator_get_stats(&ind);
+        ESP_LOGI(TAG, "💡 LED requests: posted %u dropped %u (ring peak %u/%d)",
+                 (unsigned)ind.posted, (unsigned)ind.dropped, (unsigned)ind.max_pending, INDICATOR_RING_SIZE);
         visualize_pool_usage();
 
         bool exhausted = false;
         for (int i=0;i<POOL_COUNT;i++) {
-            if (pools[i].block_count && pools[i].allocated_blocks >= pools[i].block_count) {
+            if (pools[i].block_count && pool_blocks_in_use(&pools[i]) >= pools[i].block_count) {
                 exhausted = true; break;
             }
         }
@@ -371,6 +2689,590 @@ static void pool_stress_test_task(void *arg)
     }
 }
 
+/* ---------------- Magazine benchmark ---------------- */
+#define CACHE_BENCH_ITERATIONS  2000
+#define CACHE_BENCH_BURST       4     // blocks held per round (≤ BENCH_POOL_BLOCKS / 2 cores)
+#define BENCH_POOL_BLOCKS       32
+
+/* พูลขนาดเท่า Small แต่แยกของตัวเอง: benchmark สลับ magazine/strategy ได้
+   โดยไม่ไปเปลี่ยน fast path ใต้ PoolStress/PoolMonitor/ISR demo และไม่มี traffic ของ task อื่นปนในผล */
+static memory_pool_t bench_pool;
+
+static memory_pool_t* bench_pool_get(void)
+{
+    if (!bench_pool.mutex) {
+        const pool_config_t cfg = { "Bench", SMALL_POOL_BLOCK_SIZE, BENCH_POOL_BLOCKS, 0,
+                                    MALLOC_CAP_INTERNAL, LED_POOL_FULL, true, 0 };
+        /* pool_id ต่อจาก rtos_pools */
+        if (!try_init_pool(&bench_pool, &cfg, POOL_COUNT + 2 + RTOS_POOL_COUNT, BENCH_POOL_BLOCKS)) return NULL;
+    }
+    return &bench_pool;
+}
+
+typedef struct {
+    memory_pool_t* pool;
+    int iterations;
+    uint64_t elapsed_us;
+    uint32_t failures;
+    SemaphoreHandle_t done;
+} cache_bench_arg_t;
+
+static void cache_bench_run(cache_bench_arg_t* a)
+{
+    void* blk[CACHE_BENCH_BURST];
+    uint64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < a->iterations; i++) {
+        for (int j = 0; j < CACHE_BENCH_BURST; j++) {
+            blk[j] = pool_malloc(a->pool);
+            if (!blk[j]) a->failures++;
+        }
+        for (int j = 0; j < CACHE_BENCH_BURST; j++) if (blk[j]) pool_free(a->pool, blk[j]);
+    }
+    a->elapsed_us = esp_timer_get_time() - t0;
+}
+
+static void cache_bench_worker(void *arg)
+{
+    cache_bench_arg_t* a = (cache_bench_arg_t*)arg;
+    cache_bench_run(a);
+    xSemaphoreGive(a->done);
+    vTaskDelete(NULL);
+}
+
+/* วัด alloc+free ของพูลขนาด Small ตรง ๆ (ไม่ผ่าน smart API / LED) แบบ 1 task และ 2 task คนละ core */
+static void pool_cache_benchmark(void)
+{
+    memory_pool_t* pool = bench_pool_get();
+    if (!pool) return;
+    const int ops = CACHE_BENCH_ITERATIONS * CACHE_BENCH_BURST;
+
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(portNUM_PROCESSORS, 0);
+    if (!done) return;
+
+    for (int mode = 0; mode < 2; mode++) {
+        bool cached = (mode == 1);
+        pool_set_magazines(pool, cached);
+
+        cache_bench_arg_t solo = { pool, CACHE_BENCH_ITERATIONS, 0, 0, done };
+        cache_bench_run(&solo);
+
+        cache_bench_arg_t duo[portNUM_PROCESSORS];
+        uint64_t t0 = esp_timer_get_time();
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            duo[c] = (cache_bench_arg_t){ pool, CACHE_BENCH_ITERATIONS, 0, 0, done };
+            xTaskCreatePinnedToCore(cache_bench_worker, "CacheBench", 3072, &duo[c], 4, NULL, c);
+        }
+        for (int c = 0; c < portNUM_PROCESSORS; c++) xSemaphoreTake(done, portMAX_DELAY);
+        uint64_t wall = esp_timer_get_time() - t0;
+
+        uint32_t fails = solo.failures;
+        for (int c = 0; c < portNUM_PROCESSORS; c++) fails += duo[c].failures;
+        ESP_LOGI(TAG, "cache %-3s: 1 task %.2f us/pair | %d cores %.2f us/pair, %.0f pairs/s total (fail %u)",
+                 cached ? "ON" : "OFF",
+                 (double)solo.elapsed_us / ops,
+                 portNUM_PROCESSORS, (double)wall / ops,
+                 wall ? (double)ops * portNUM_PROCESSORS * 1e6 / wall : 0.0,
+                 (unsigned)fails);
+    }
+    pool_set_magazines(pool, true);
+    vSemaphoreDelete(done);
+}
+
+/* ---------------- Bulk benchmark ---------------- */
+#define BULK_BENCH_ROUNDS  500
+#define BULK_BENCH_BATCH   16
+
+/* ต้นทุนต่อบล็อก: pool_malloc/pool_free ทีละตัว เทียบกับ pool_malloc_bulk/pool_free_bulk */
+static void pool_bulk_benchmark(void)
+{
+    memory_pool_t* pool = &pools[POOL_SMALL];
+    if (!pool->mutex) return;
+    void* blk[BULK_BENCH_BATCH];
+    size_t batch = pool->block_count / 2;
+    if (batch > BULK_BENCH_BATCH) batch = BULK_BENCH_BATCH;
+    if (batch == 0) return;
+
+    uint64_t single_alloc = 0, single_free = 0, bulk_alloc = 0, bulk_free = 0;
+    size_t single_n = 0, bulk_n = 0;
+    for (int r = 0; r < BULK_BENCH_ROUNDS; r++) {
+        uint64_t t0 = esp_timer_get_time();
+        size_t got = 0;
+        for (size_t i = 0; i < batch; i++) {
+            blk[i] = pool_malloc(pool);
+            if (blk[i]) got++;
+        }
+        uint64_t t1 = esp_timer_get_time();
+        for (size_t i = 0; i < batch; i++) if (blk[i]) pool_free(pool, blk[i]);
+        uint64_t t2 = esp_timer_get_time();
+        single_alloc += t1 - t0; single_free += t2 - t1; single_n += got;
+
+        t0 = esp_timer_get_time();
+        got = pool_malloc_bulk(pool, batch, blk);
+        t1 = esp_timer_get_time();
+        pool_free_bulk(pool, got, blk);
+        t2 = esp_timer_get_time();
+        bulk_alloc += t1 - t0; bulk_free += t2 - t1; bulk_n += got;
+    }
+
+    ESP_LOGI(TAG, "batch %u: single alloc %.2f free %.2f us/obj | bulk alloc %.2f free %.2f us/obj",
+             (unsigned)batch,
+             single_n ? (double)single_alloc / single_n : 0.0,
+             single_n ? (double)single_free  / single_n : 0.0,
+             bulk_n   ? (double)bulk_alloc   / bulk_n   : 0.0,
+             bulk_n   ? (double)bulk_free    / bulk_n   : 0.0);
+}
+
+/* ---------------- Strategy benchmark ---------------- */
+#define STRATEGY_BENCH_ROUNDS  500
+
+/* วัดที่ free list กลางโดยตรง (ปิด magazine): เวลา alloc+free และ index บล็อกสูงสุดที่ถูกใช้
+   ภายใต้รูปแบบ alloc ชุด -> free สลับตัว -> alloc ครึ่งชุด -> free ทั้งหมด */
+static void pool_strategy_benchmark(void)
+{
+    memory_pool_t* pool = bench_pool_get();
+    if (!pool) return;
+    const pool_strategy_t saved = pool->strategy;
+    void* blk[BULK_BENCH_BATCH];
+    size_t batch = pool->base_block_count / 2;
+    if (batch > BULK_BENCH_BATCH) batch = BULK_BENCH_BATCH;
+    if (batch < 2) return;
+
+    pool_set_magazines(pool, false);
+    for (int s = 0; s < 2; s++) {
+        pool_strategy_t strategy = (s == 0) ? POOL_STRATEGY_FREELIST : POOL_STRATEGY_BITMAP;
+        pool_set_strategy(pool, strategy);
+        size_t high_water = 0, ops = 0;
+        uint64_t t0 = esp_timer_get_time();
+        for (int r = 0; r < STRATEGY_BENCH_ROUNDS; r++) {
+            for (size_t i = 0; i < batch; i++) blk[i] = pool_malloc(pool);
+            for (size_t i = 1; i < batch; i += 2) { pool_free(pool, blk[i]); blk[i] = NULL; }
+            for (size_t i = 1; i < batch; i += 2) blk[i] = pool_malloc(pool);
+            for (size_t i = 0; i < batch; i++) {
+                if (!blk[i]) continue;
+                size_t idx = pool_block_index(pool, user_to_block(pool, blk[i]));
+                if (idx > high_water) high_water = idx;
+                pool_free(pool, blk[i]);
+                ops++;
+            }
+        }
+        uint64_t elapsed = esp_timer_get_time() - t0;
+        ESP_LOGI(TAG, "strategy %-8s: %.2f us/alloc+free, highest block index %u",
+                 strategy == POOL_STRATEGY_BITMAP ? "bitmap" : "freelist",
+                 ops ? (double)elapsed / ops : 0.0, (unsigned)high_water);
+    }
+    pool_set_strategy(pool, saved);
+    pool_set_magazines(pool, true);
+}
+
+/* ---------------- RTOS factory benchmark ---------------- */
+/* สร้าง/ลบ object แบบ dynamic เทียบกับ factory + ดูว่า heap ไม่ขยับเลย */
+#define RTOS_FACTORY_BENCH_ROUNDS  100
+
+static void rtos_dummy_timer_cb(TimerHandle_t t) { (void)t; }
+
+static void rtos_factory_benchmark(void)
+{
+    if (!rtos_queue_storage) return;
+    for (int m = 0; m < 2; m++) {
+        bool pooled = (m == 1);
+        size_t heap0 = esp_get_free_heap_size();
+        uint64_t t0 = esp_timer_get_time();
+        for (int r = 0; r < RTOS_FACTORY_BENCH_ROUNDS; r++) {
+            QueueHandle_t q = pooled ? rtos_queue_create(8, sizeof(uint32_t)) : xQueueCreate(8, sizeof(uint32_t));
+            SemaphoreHandle_t s = pooled ? rtos_mutex_create() : xSemaphoreCreateMutex();
+            TimerHandle_t t = pooled ? rtos_timer_create("bench", pdMS_TO_TICKS(1000), pdFALSE, NULL, rtos_dummy_timer_cb)
+                                     : xTimerCreate("bench", pdMS_TO_TICKS(1000), pdFALSE, NULL, rtos_dummy_timer_cb);
+            EventGroupHandle_t e = pooled ? rtos_event_group_create() : xEventGroupCreate();
+            if (pooled) {
+                rtos_queue_delete(q);
+                rtos_semaphore_delete(s);
+                if (t) rtos_timer_delete(t, portMAX_DELAY);
+                rtos_event_group_delete(e);
+            } else {
+                if (q) vQueueDelete(q);
+                if (s) vSemaphoreDelete(s);
+                if (t) xTimerDelete(t, portMAX_DELAY);
+                if (e) vEventGroupDelete(e);
+            }
+        }
+        uint64_t elapsed = esp_timer_get_time() - t0;
+        vTaskDelay(pdMS_TO_TICKS(20));   // ให้ timer daemon ลบ timer ที่ค้างเสร็จก่อนวัด heap
+        ESP_LOGI(TAG, "RTOS objects %s: %.2f us per create+delete set | heap delta %d B",
+                 pooled ? "static/pool" : "dynamic",
+                 (double)elapsed / RTOS_FACTORY_BENCH_ROUNDS,
+                 (int)esp_get_free_heap_size() - (int)heap0);
+    }
+}
+
+/* ต้นทุนต่อครั้งของ policy ที่คอมไพล์มา (เส้นทางปกติ: magazine) — build ใหม่ด้วย
+   -DPOOL_POLICY=0/1/2 แล้วเทียบบรรทัดนี้ */
+#define POLICY_BENCH_OPS  1000
+
+static void pool_policy_benchmark(void)
+{
+    memory_pool_t* pool = &pools[POOL_SMALL];
+    if (!pool->mutex) return;
+    uint64_t alloc_cycles = 0, free_cycles = 0;
+    uint32_t n = 0;
+    for (int i = 0; i < POLICY_BENCH_OPS; i++) {
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        void* p = pool_malloc(pool);
+        uint32_t c1 = esp_cpu_get_cycle_count();
+        if (!p) continue;
+        pool_free(pool, p);
+        uint32_t c2 = esp_cpu_get_cycle_count();
+        alloc_cycles += c1 - c0;
+        free_cycles  += c2 - c1;
+        n++;
+    }
+    if (!n) return;
+    ESP_LOGI(TAG, "policy %s: alloc %.0f cycles/op, free %.0f cycles/op (%u pairs)",
+             POOL_POLICY_NAME, (double)alloc_cycles / n, (double)free_cycles / n, (unsigned)n);
+}
+
+/* ทุกพูลต้องให้ pointer ที่ตรง alignment ของตัวเอง ทั้งบล็อกจาก base และจาก slab */
+static void pool_alignment_selftest(void)
+{
+    for (int i = 0; i < POOL_COUNT; i++) {
+        memory_pool_t* pool = &pools[i];
+        if (!pool->mutex) continue;
+        void* p = (i == POOL_DMA) ? dma_pool_malloc(pool->block_size) : pool_malloc(pool);
+        if (!p) continue;
+        bool ok = ((uintptr_t)p & (pool->alignment - 1)) == 0;
+        ESP_LOGI(TAG, "%s: align %u -> %p %s", pool->name, (unsigned)pool->alignment, p,
+                 ok ? "OK" : "MISALIGNED 🚨");
+        if (!ok) gpio_set_level(LED_POOL_ERROR, 1);
+        smart_pool_free(p);
+    }
+}
+
+/* ---------------- Handle self-test ---------------- */
+/* ส่ง handle 4 ไบต์ผ่าน queue แทน pointer แล้วตรวจว่า handle เก่าหลัง free/จองใหม่ถูกปฏิเสธ */
+static void pool_handle_selftest(void)
+{
+    QueueHandle_t q = xQueueCreate(4, sizeof(pool_handle_t));
+    if (!q) return;
+
+    pool_handle_t h = pool_malloc_handle(&pools[POOL_SMALL]);
+    if (h == POOL_HANDLE_INVALID) { vQueueDelete(q); return; }
+    strcpy((char*)pool_handle_ptr(h), "via handle");
+    xQueueSend(q, &h, 0);
+
+    pool_handle_t rx = POOL_HANDLE_INVALID;
+    xQueueReceive(q, &rx, 0);
+    bool delivered = pool_handle_ptr(rx) && strcmp((char*)pool_handle_ptr(rx), "via handle") == 0;
+    pool_free_handle(rx);
+
+    pool_handle_t reuse = pool_malloc_handle(&pools[POOL_SMALL]);
+    bool stale_rejected = (pool_handle_ptr(rx) == NULL);
+    if (reuse != POOL_HANDLE_INVALID) pool_free_handle(reuse);
+
+    ESP_LOGI(TAG, "handles: delivered %s, stale handle %s",
+             delivered ? "OK" : "FAIL", stale_rejected ? "rejected" : "ACCEPTED (bug)");
+    vQueueDelete(q);
+}
+
+/* movable buffer ใน Large pool มากพอให้โต 1 slab, free ตัวที่อยู่ใน base แล้วสั่ง compaction:
+   ข้อมูลต้องอยู่ครบหลังย้าย และ slab ควรถูกคืน (ถ้า task อื่นไม่ได้ถือ block ใน slab นั้นอยู่) */
+static void pool_compaction_selftest(void)
+{
+    memory_pool_t* pool = &pools[POOL_LARGE];
+    if (!pool->mutex || !pool->max_slabs) return;
+
+    pool_movable_t h[POOL_MOVABLE_MAX];
+    size_t n = pool->base_block_count + pool->slab_blocks;
+    if (n > POOL_MOVABLE_MAX) n = POOL_MOVABLE_MAX;
+    for (size_t i = 0; i < n; i++) {
+        h[i] = movable_malloc(pool->block_size);
+        void* p = movable_lock_ptr(h[i]);
+        if (p) memset(p, (int)(0x40 + i), pool->block_size);
+        movable_unlock(h[i]);
+    }
+
+    pool_stats_t before;
+    pool_stats_snapshot(pool, &before);
+    size_t freed = 0;
+    for (size_t i = 0; i < n && freed < pool->slab_blocks; i++) {
+        void* p = movable_lock_ptr(h[i]);
+        size_t idx;
+        bool in_base = p && pool_locate(pool, user_to_block(pool, p), &idx) == POOL_SLAB_BASE;
+        movable_unlock(h[i]);
+        if (in_base) {
+            movable_free(h[i]);
+            h[i] = POOL_MOVABLE_INVALID;
+            freed++;
+        }
+    }
+
+    pool_compaction_stats_t run;
+    size_t released = pool_compact(pool, &run);
+    pool_stats_t after;
+    pool_stats_snapshot(pool, &after);
+
+    bool intact = true;
+    for (size_t i = 0; i < n; i++) {
+        if (h[i] == POOL_MOVABLE_INVALID) continue;
+        const uint8_t* p = (const uint8_t*)movable_lock_ptr(h[i]);
+        for (size_t b = 0; p && b < pool->block_size; b++) {
+            if (p[b] != (uint8_t)(0x40 + i)) { intact = false; break; }
+        }
+        movable_unlock(h[i]);
+        movable_free(h[i]);
+    }
+
+    ESP_LOGI(TAG, "🧲 %s compaction: slabs %u -> %u (released %u), moved %u blocks, data %s",
+             pool->name, (unsigned)before.live_slabs, (unsigned)after.live_slabs, (unsigned)released,
+             (unsigned)run.blocks_moved, intact ? "intact" : "CORRUPTED 🚨");
+}
+
+/* ---------------- Lock-free torture & throughput ----------------
+   ใช้พูลแยกของตัวเอง (ไม่อยู่ใน pools[]) เพื่อสลับ strategy ได้โดยไม่ชนกับ task อื่น */
+#define LF_BENCH_BLOCKS      32
+#define LF_BENCH_ITERATIONS  2000
+#define LF_BENCH_HOLD        3       // blocks per task at most (8 tasks × 3 < 32: ไม่ควร fail)
+
+static memory_pool_t lf_bench_pool;
+
+typedef struct {
+    int iterations;
+    uint8_t pattern;
+    uint32_t ops;
+    uint32_t failures;
+    uint32_t corruptions;
+    SemaphoreHandle_t done;
+} lf_worker_arg_t;
+
+/* ดัดแปลงจาก pool_stress_test_task: alloc/free สุ่ม + เติม pattern แล้วตรวจก่อน free */
+static void lf_torture_worker(void *arg)
+{
+    lf_worker_arg_t* a = (lf_worker_arg_t*)arg;
+    const size_t sz = lf_bench_pool.block_size;
+    void* held[LF_BENCH_HOLD] = {0};
+    int n = 0;
+    uint32_t rng = 0x9E3779B9u * (a->pattern + 1);
+
+    for (int i = 0; i < a->iterations; i++) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        if (n < LF_BENCH_HOLD && (n == 0 || (rng & 1))) {
+            void* p = pool_malloc(&lf_bench_pool);
+            if (p) { memset(p, a->pattern, sz); held[n++] = p; }
+            else a->failures++;
+        } else {
+            int idx = (int)((rng >> 1) % (uint32_t)n);
+            uint8_t* d = (uint8_t*)held[idx];
+            for (size_t j = 0; j < sz; j++) { if (d[j] != a->pattern) { a->corruptions++; break; } }
+            pool_free(&lf_bench_pool, held[idx]);
+            held[idx] = held[--n];
+        }
+        a->ops++;
+    }
+    while (n) pool_free(&lf_bench_pool, held[--n]);
+    xSemaphoreGive(a->done);
+    vTaskDelete(NULL);
+}
+
+static size_t lf_bench_free_blocks(void)
+{
+    size_t free_blocks = 0;
+    if (lf_bench_pool.strategy == POOL_STRATEGY_LOCKFREE) {
+        for (uint32_t i = lf_bench_pool.lf_head & LF_INDEX_MASK; i && free_blocks <= LF_BENCH_BLOCKS; i = lf_bench_pool.lf_next[i - 1]) free_blocks++;
+    } else {
+        for (memory_block_t* b = lf_bench_pool.free_list; b && free_blocks <= LF_BENCH_BLOCKS; b = b->next) free_blocks++;
+        free_blocks += lf_bench_pool.base_block_count - lf_bench_pool.carve_next;
+    }
+    return free_blocks;
+}
+
+static void pool_lockfree_benchmark(void)
+{
+    static const int task_counts[] = {1, 2, 4, 8};
+    if (!lf_bench_pool.mutex) {
+        const pool_config_t cfg = { "LFBench", 64, LF_BENCH_BLOCKS, 0, MALLOC_CAP_INTERNAL, LED_POOL_FULL, false, 0 };
+        if (!try_init_pool(&lf_bench_pool, &cfg, POOL_COUNT + 1, LF_BENCH_BLOCKS)) return;
+        lf_bench_pool.no_magazines = true;
+    }
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(8, 0);
+    if (!done) return;
+    lf_worker_arg_t args[8];
+
+    for (int m = 0; m < 2; m++) {
+        pool_strategy_t strategy = (m == 0) ? POOL_STRATEGY_FREELIST : POOL_STRATEGY_LOCKFREE;
+        pool_set_strategy(&lf_bench_pool, strategy);
+        for (size_t t = 0; t < sizeof(task_counts) / sizeof(task_counts[0]); t++) {
+            int tasks = task_counts[t];
+            uint64_t t0 = esp_timer_get_time();
+            for (int i = 0; i < tasks; i++) {
+                args[i] = (lf_worker_arg_t){ LF_BENCH_ITERATIONS, (uint8_t)(0xA0 + i), 0, 0, 0, done };
+                xTaskCreatePinnedToCore(lf_torture_worker, "LFWorker", 3072, &args[i], 4, NULL,
+                                        i % portNUM_PROCESSORS);
+            }
+            for (int i = 0; i < tasks; i++) xSemaphoreTake(done, portMAX_DELAY);
+            uint64_t wall = esp_timer_get_time() - t0;
+
+            uint32_t ops = 0, fails = 0, corrupt = 0;
+            for (int i = 0; i < tasks; i++) {
+                ops += args[i].ops; fails += args[i].failures; corrupt += args[i].corruptions;
+            }
+            size_t free_blocks = lf_bench_free_blocks();
+            ESP_LOGI(TAG, "%-8s %d task(s): %.0f ops/s | fail %u corrupt %u | free %u/%u%s",
+                     strategy == POOL_STRATEGY_LOCKFREE ? "lockfree" : "mutex", tasks,
+                     wall ? (double)ops * 1e6 / wall : 0.0,
+                     (unsigned)fails, (unsigned)corrupt,
+                     (unsigned)free_blocks, (unsigned)lf_bench_pool.block_count,
+                     (free_blocks == lf_bench_pool.block_count && !corrupt) ? "" : "  🚨");
+        }
+    }
+    vSemaphoreDelete(done);
+}
+
+/* ---------------- Multi-task contention benchmark ----------------
+   producer N ตัว (กระจายทั้งสอง core) จองบล็อกแล้วส่งผ่าน queue ให้ consumer M ตัวเป็นคน free
+   -> มีทั้งการแย่ง mutex และการ free ข้าม task/ข้าม core แบบงานจริง; วัดแยกทีละ geometry บนพูลส่วนตัว
+   แต่ละพูลรันสองรอบ: ปิดแล้วเปิด remote-free list เพื่อเทียบจำนวนครั้งที่ต้องถือ mutex */
+#define CONTENTION_BENCH_ENABLED    1
+#define CONTENTION_BENCH_PRODUCERS  4
+#define CONTENTION_BENCH_CONSUMERS  2
+#define CONTENTION_BENCH_OPS        500     // allocations per producer
+#define CONTENTION_BENCH_QUEUE      16      // blocks in flight between producers and consumers
+#define CONTENTION_BENCH_STAMP      0x5A5A0000u
+
+typedef struct {
+    memory_pool_t* pool;
+    QueueHandle_t queue;
+    SemaphoreHandle_t done;
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t consumed;
+    uint32_t corruptions;
+    pool_latency_hist_t alloc_hist;
+    pool_latency_hist_t free_hist;
+} contention_run_t;
+
+static void contention_producer(void *arg)
+{
+    contention_run_t* r = (contention_run_t*)arg;
+    for (int i = 0; i < CONTENTION_BENCH_OPS; i++) {
+        __atomic_fetch_add(&r->attempts, 1, __ATOMIC_RELAXED);
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        void* p = pool_malloc(r->pool);
+        pool_latency_record(&r->alloc_hist, esp_cpu_get_cycle_count() - c0);
+        if (!p) {
+            __atomic_fetch_add(&r->failures, 1, __ATOMIC_RELAXED);
+            taskYIELD();   // ให้ consumer ได้คืนบล็อก
+            continue;
+        }
+        *(uint32_t*)p = CONTENTION_BENCH_STAMP ^ (uint32_t)(uintptr_t)p;
+        if (xQueueSend(r->queue, &p, pdMS_TO_TICKS(100)) != pdTRUE) pool_free(r->pool, p);
+    }
+    xSemaphoreGive(r->done);
+    vTaskDelete(NULL);
+}
+
+static void contention_consumer(void *arg)
+{
+    contention_run_t* r = (contention_run_t*)arg;
+    void* p;
+    /* NULL = producer ทุกตัวเสร็จแล้ว */
+    while (xQueueReceive(r->queue, &p, portMAX_DELAY) == pdTRUE && p) {
+        if (*(uint32_t*)p != (CONTENTION_BENCH_STAMP ^ (uint32_t)(uintptr_t)p)) {
+            __atomic_fetch_add(&r->corruptions, 1, __ATOMIC_RELAXED);
+        }
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        pool_free(r->pool, p);
+        pool_latency_record(&r->free_hist, esp_cpu_get_cycle_count() - c0);
+        __atomic_fetch_add(&r->consumed, 1, __ATOMIC_RELAXED);
+    }
+    xSemaphoreGive(r->done);
+    vTaskDelete(NULL);
+}
+
+/* config ที่ app_main ใช้บูตพูลหลัก (หลังปรับตาม PSRAM) — benchmark สร้างพูลส่วนตัวจาก geometry เดียวกัน */
+static pool_config_t pool_configs[POOL_COUNT];
+static memory_pool_t contention_pool;
+
+static void pool_contention_benchmark(void)
+{
+#if CONTENTION_BENCH_ENABLED
+    static contention_run_t run;
+    QueueHandle_t queue = xQueueCreate(CONTENTION_BENCH_QUEUE, sizeof(void*));
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(CONTENTION_BENCH_PRODUCERS + CONTENTION_BENCH_CONSUMERS, 0);
+    if (!queue || !done) {
+        if (queue) vQueueDelete(queue);
+        if (done) vSemaphoreDelete(done);
+        return;
+    }
+
+    ESP_LOGI(TAG, "🏁 contention: %d producers -> %d consumers, %d allocs each",
+             CONTENTION_BENCH_PRODUCERS, CONTENTION_BENCH_CONSUMERS, CONTENTION_BENCH_OPS);
+    for (int i = 0; i < POOL_COUNT; i++) {
+        if (!pools[i].mutex) continue;
+        /* พูลส่วนตัว geometry เดียวกับพูลจริง สร้างใหม่ทุกรอบ: ตัวนับ/ฮิสโตแกรมเริ่มจากศูนย์ ไม่มี traffic
+           ของ PoolStress ปน และไม่ไปทำให้พูลของแอปโตหรือหมด; ไม่โต (slab จะต้องไปลง pool_index) */
+        pool_config_t cfg = pool_configs[i];
+        cfg.max_block_count = 0;
+        memory_pool_t* pool = &contention_pool;
+        uint32_t acquisitions[2] = {0};
+
+        for (int rf = 0; rf < 2; rf++) {
+            if (!try_init_pool(pool, &cfg, POOL_COUNT + 3 + RTOS_POOL_COUNT, cfg.block_count)) {
+                ESP_LOGW(TAG, "%s: no heap for a private benchmark pool, skipped", cfg.name);
+                break;
+            }
+            pool->no_remote_free = !rf;   // เฉพาะพูลทดสอบ — พูลของแอปไม่ถูกสลับ free path
+            memset(&run, 0, sizeof(run));
+            run.pool = pool;
+            run.queue = queue;
+            run.done = done;
+
+            /* warning "pool exhausted" ต่อครั้งจะกลบผลและทำให้ UART เป็นคอขวดแทนพูล:
+               ปิดเฉพาะ warning ของพูลทดสอบ แล้วสรุปจำนวนตอนจบ */
+            pool->quiet_exhaustion = true;
+            uint64_t t0 = esp_timer_get_time();
+            for (int c = 0; c < CONTENTION_BENCH_CONSUMERS; c++) {
+                xTaskCreatePinnedToCore(contention_consumer, "PoolCons", 3072, &run, 4, NULL,
+                                        (c + 1) % portNUM_PROCESSORS);
+            }
+            for (int p = 0; p < CONTENTION_BENCH_PRODUCERS; p++) {
+                xTaskCreatePinnedToCore(contention_producer, "PoolProd", 3072, &run, 4, NULL,
+                                        p % portNUM_PROCESSORS);
+            }
+            for (int p = 0; p < CONTENTION_BENCH_PRODUCERS; p++) xSemaphoreTake(done, portMAX_DELAY);
+            void* stop = NULL;
+            for (int c = 0; c < CONTENTION_BENCH_CONSUMERS; c++) xQueueSend(queue, &stop, portMAX_DELAY);
+            for (int c = 0; c < CONTENTION_BENCH_CONSUMERS; c++) xSemaphoreTake(done, portMAX_DELAY);
+            uint64_t wall = esp_timer_get_time() - t0;
+            if (pool->quiet_exhaustion_count) {
+                ESP_LOGW(TAG, "🔴 %s: pool exhausted %u times during benchmark run", pool->name,
+                         (unsigned)pool->quiet_exhaustion_count);
+            }
+            /* task ทั้งหมดจบแล้ว: ค่าสะสมของพูลส่วนตัวคือผลของรอบนี้ทั้งหมด อ่านตรง ๆ ได้ */
+            acquisitions[rf] = pool->mutex_acquisitions;
+            pool_latency_hist_t wait = pool->mutex_wait;
+
+            uint32_t allocs = run.attempts - run.failures;
+            ESP_LOGI(TAG, "%s (%uB × %u, remote free %s): %.0f ops/s | alloc fail %u/%u (%.1f%%, pool counter %u) | freed %u corrupt %u | mutex %u%s",
+                     pool->name, (unsigned)pool->block_size, (unsigned)pool->block_count,
+                     rf ? "on" : "off",
+                     wall ? (double)(allocs + run.consumed) * 1e6 / wall : 0.0,
+                     (unsigned)run.failures, (unsigned)run.attempts,
+                     run.attempts ? 100.0 * run.failures / run.attempts : 0.0,
+                     (unsigned)pool->allocation_failures,
+                     (unsigned)run.consumed, (unsigned)run.corruptions,
+                     (unsigned)acquisitions[rf], run.corruptions ? "  🚨" : "");
+            print_pool_latency(pool, "bench alloc", &run.alloc_hist);
+            print_pool_latency(pool, "bench free",  &run.free_hist);
+            print_pool_latency(pool, "bench mutex wait", &wait);
+            pool_destroy(pool);
+        }
+        ESP_LOGI(TAG, "🔁 %s: mutex acquisitions %u -> %u with remote-free lists (%.1f%% fewer)",
+                 cfg.name, (unsigned)acquisitions[0], (unsigned)acquisitions[1],
+                 acquisitions[0] ? 100.0 * ((double)acquisitions[0] - acquisitions[1]) / acquisitions[0] : 0.0);
+    }
+    vQueueDelete(queue);
+    vSemaphoreDelete(done);
+#endif
+}
+
 static void pool_perf_task(void *arg)
 {
     const int N=400;
@@ -389,14 +3291,74 @@ static void pool_perf_task(void *arg)
                      (unsigned)sz,
                      (double)(t1-t0)/N, (double)(t2-t1)/N);
         }
+        pool_cache_benchmark();
+        pool_bulk_benchmark();
+        pool_strategy_benchmark();
+        pool_handle_selftest();
+        pool_compaction_selftest();
+        pool_alignment_selftest();
+        pool_policy_benchmark();
+        pool_allocator_benchmark();
+        rtos_factory_benchmark();
+        pool_lockfree_benchmark();
+        pool_contention_benchmark();
         vTaskDelay(pdMS_TO_TICKS(30000));
     }
 }
 
+/* ---------------- ISR demo (gptimer) ---------------- */
+#define ISR_DEMO_PERIOD_US   10000   // 10 ms
+#define ISR_DEMO_HELD        4       // blocks the ISR keeps in flight
+
+static gptimer_handle_t isr_demo_timer = NULL;
+static void* isr_demo_blocks[ISR_DEMO_HELD];
+static uint32_t isr_demo_slot = 0;
+
+// Timer callback function (ISR context): คืน block เก่าสุดแล้วจองใหม่จาก Small pool
+static bool IRAM_ATTR isr_demo_callback(gptimer_handle_t timer,
+                                        const gptimer_alarm_event_data_t *edata,
+                                        void *user_data)
+{
+    memory_pool_t* pool = &pools[POOL_SMALL];
+    void** slot = &isr_demo_blocks[isr_demo_slot];
+    if (*slot) pool_free_from_isr(pool, *slot);
+    *slot = pool_malloc_from_isr(pool);
+    if (*slot) *(uint32_t*)*slot = (uint32_t)edata->count_value;
+    isr_demo_slot = (isr_demo_slot + 1) % ISR_DEMO_HELD;
+    return false;
+}
+
+static void start_isr_demo(void)
+{
+    if (!pools[POOL_SMALL].pool_memory) return;
+    pool_prepare_isr(&pools[POOL_SMALL]);
+
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    ESP_ERROR_CHECK(gptimer_new_timer(&timer_config, &isr_demo_timer));
+
+    gptimer_event_callbacks_t cbs = { .on_alarm = isr_demo_callback };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(isr_demo_timer, &cbs, NULL));
+    ESP_ERROR_CHECK(gptimer_enable(isr_demo_timer));
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = ISR_DEMO_PERIOD_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(isr_demo_timer, &alarm_config));
+    ESP_ERROR_CHECK(gptimer_start(isr_demo_timer));
+    ESP_LOGI(TAG, "ISR demo: gptimer every %u us using pool_malloc_from_isr/pool_free_from_isr",
+             (unsigned)ISR_DEMO_PERIOD_US);
+}
+
 /* ---------------- App init ---------------- */
 void app_main(void)
 {
-    ESP_LOGI(TAG, "🚀 Memory Pools Lab Starting...");
+    ESP_LOGI(TAG, "🚀 Memory Pools Lab Starting... (policy: %s)", POOL_POLICY_NAME);
 
     // GPIO
     gpio_set_direction(LED_SMALL_POOL,  GPIO_MODE_OUTPUT);
@@ -409,6 +3371,7 @@ void app_main(void)
     gpio_set_level(LED_LARGE_POOL, 0);
     gpio_set_level(LED_POOL_FULL,  0);
     gpio_set_level(LED_POOL_ERROR, 0);
+    indicator_init(INDICATOR_TASK_PRIORITY);
 
     /* ตรวจ PSRAM */
     size_t spiram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
@@ -417,33 +3380,49 @@ void app_main(void)
 
     /* config พูล (huge pool จะใช้ SPIRAM ถ้ามี) */
     pool_config_t cfgs[POOL_COUNT] = {
-        { "Small",  SMALL_POOL_BLOCK_SIZE,  SMALL_POOL_BLOCK_COUNT,  MALLOC_CAP_INTERNAL, LED_SMALL_POOL  },
-        { "Medium", MEDIUM_POOL_BLOCK_SIZE, MEDIUM_POOL_BLOCK_COUNT, MALLOC_CAP_INTERNAL, LED_MEDIUM_POOL },
-        { "Large",  LARGE_POOL_BLOCK_SIZE,  LARGE_POOL_BLOCK_COUNT,  MALLOC_CAP_DEFAULT,  LED_LARGE_POOL  },
-        { "Huge",   HUGE_POOL_BLOCK_SIZE,   HUGE_POOL_BLOCK_COUNT,   has_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DEFAULT, LED_POOL_FULL }
+        { "Small",  SMALL_POOL_BLOCK_SIZE,  SMALL_POOL_BLOCK_COUNT,  SMALL_POOL_MAX_BLOCKS,  MALLOC_CAP_INTERNAL, LED_SMALL_POOL,  true,  0 },
+        { "Medium", MEDIUM_POOL_BLOCK_SIZE, MEDIUM_POOL_BLOCK_COUNT, MEDIUM_POOL_MAX_BLOCKS, MALLOC_CAP_INTERNAL, LED_MEDIUM_POOL, true,  0 },
+        { "Large",  LARGE_POOL_BLOCK_SIZE,  LARGE_POOL_BLOCK_COUNT,  LARGE_POOL_MAX_BLOCKS,  MALLOC_CAP_DEFAULT,  LED_LARGE_POOL,  false, 0 },
+        { "Huge",   HUGE_POOL_BLOCK_SIZE,   HUGE_POOL_BLOCK_COUNT,   HUGE_POOL_MAX_BLOCKS,   has_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DEFAULT, LED_POOL_FULL, false, HUGE_POOL_ALIGNMENT },
+        /* metadata นอกบล็อก: บัฟเฟอร์ DMA ติดกันโดยไม่มี header คั่นและไม่แชร์ cache line กับ header */
+        { "DMA",    DMA_POOL_BLOCK_SIZE,    DMA_POOL_BLOCK_COUNT,    DMA_POOL_MAX_BLOCKS,    MALLOC_CAP_DMA,      LED_LARGE_POOL,  true,  DMA_POOL_ALIGNMENT }
     };
 
     /* ถ้าไม่มี PSRAM และ heap ค่อนข้างจำกัด ให้ลด huge ลงไปอีก */
     if (!has_psram) {
         cfgs[POOL_HUGE].block_count = 1;  // ป้องกัน OOM
+        cfgs[POOL_HUGE].max_block_count = 2;
         ESP_LOGW(TAG, "No PSRAM -> limiting Huge pool to %u block", (unsigned)cfgs[POOL_HUGE].block_count);
     }
 
     /* init pools แบบ safe (จะลด block_count ลงถ้าไม่พอ) */
+    int64_t init_start = esp_timer_get_time();
     for (int i=0;i<POOL_COUNT;i++) {
+        pool_configs[i] = cfgs[i];
         if (!init_memory_pool_safely(&pools[i], &cfgs[i], (uint32_t)(i+1))) {
             ESP_LOGE(TAG, "Failed to init %s pool — continuing without it", cfgs[i].name);
             // ปล่อยว่าง pool นี้ (smart allocator จะตกไป heap ปกติ)
         }
     }
 
+    if (!rtos_factory_init()) {
+        ESP_LOGE(TAG, "Static RTOS object pools unavailable — rtos_*_create will return NULL");
+    }
+    int64_t init_us = esp_timer_get_time() - init_start;
+
+    movable_init();
     print_pool_statistics();
+    start_isr_demo();
 
     // tasks
     xTaskCreate(pool_monitor_task,     "PoolMonitor", 4096, NULL, 5, NULL);
     xTaskCreate(pool_stress_test_task, "PoolStress",  4096, NULL, 5, NULL);
     xTaskCreate(pool_perf_task,        "PoolPerf",    4096, NULL, 4, NULL);
 
+    /* esp_timer เริ่มนับตั้งแต่บูต: ค่านี้คือ boot-to-ready; สลับ POOL_LAZY_CARVE แล้วเทียบกัน */
+    ESP_LOGI(TAG, "⏱️ Boot-to-ready: %lld us (pool init %lld us, lazy carving %s)",
+             (long long)esp_timer_get_time(), (long long)init_us, POOL_LAZY_CARVE ? "ON" : "OFF");
+
     ESP_LOGI(TAG, "\n🎯 LEDs:");
     ESP_LOGI(TAG, "  GPIO2  Small (64B) activity");
     ESP_LOGI(TAG, "  GPIO4  Medium (256B) activity");
@@ -0,0 +1,41 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "freertos/event_groups.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* จองจากพูลตาม size class, เต็ม/ใหญ่เกิน/พูลของ size class นั้น alignment < align -> heap
+   (ไม่ย้ายไปพูลใหญ่กว่าเพื่อ alignment); คืนด้วย memory_pool_free */
+void* memory_pool_alloc(size_t size, size_t align);
+void memory_pool_free(void* ptr);
+/* ชื่อพูลที่ ptr (รวม pointer ภายในบล็อก) อยู่ หรือ "heap" */
+const char* memory_pool_owner_name(const void* ptr);
+
+/* FreeRTOS object แบบ static: control block (+ storage ของ queue) มาจากพูลที่จองไว้ตอนบูต
+   ต้องลบด้วยฟังก์ชันคู่กันเท่านั้น; พูลเต็ม/คิวใหญ่เกิน RTOS_QUEUE_STORAGE_BYTES -> NULL */
+bool rtos_factory_init(void);
+QueueHandle_t rtos_queue_create(UBaseType_t length, UBaseType_t item_size);
+void rtos_queue_delete(QueueHandle_t queue);
+SemaphoreHandle_t rtos_mutex_create(void);
+SemaphoreHandle_t rtos_binary_semaphore_create(void);
+SemaphoreHandle_t rtos_counting_semaphore_create(UBaseType_t max_count, UBaseType_t initial);
+void rtos_semaphore_delete(SemaphoreHandle_t sem);
+TimerHandle_t rtos_timer_create(const char* name, TickType_t period, UBaseType_t auto_reload,
+                                void* timer_id, TimerCallbackFunction_t callback);
+bool rtos_timer_delete(TimerHandle_t timer, TickType_t wait);   // block คืนพูลหลัง daemon ลบเสร็จ
+EventGroupHandle_t rtos_event_group_create(void);
+void rtos_event_group_delete(EventGroupHandle_t group);
+
+/* std::list / std::map: PoolAllocator<T> เทียบกับ std::allocator (pool_allocator_bench.cpp) */
+void pool_allocator_benchmark(void);
+
+#ifdef __cplusplus
+}
+#endif
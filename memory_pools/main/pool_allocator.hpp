@@ -0,0 +1,58 @@
+#pragma once
+// pool_allocator.hpp — header-only C++ Allocator over memory_pools.c
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include "memory_pools.h"
+
+/* ใช้กับ container ได้ทุกตัว: std::list<int, PoolAllocator<int>>, std::map<K, V, std::less<K>,
+   PoolAllocator<std::pair<const K, V>>> ... node แต่ละตัวไปที่พูลของ size class ที่พอดี
+   (rebind ทำให้ได้ขนาด node จริง ไม่ใช่ sizeof(T)); ใหญ่เกิน/พูลเต็ม/alignof(T) เกิน alignment ของพูล -> heap
+   ไม่มี state: ทุก instance เท่ากัน จึง splice/swap ข้าม container ได้ */
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    template <typename U>
+    struct rebind { using other = PoolAllocator<U>; };
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_type n)
+    {
+        if (n > std::numeric_limits<size_type>::max() / sizeof(T)) fail();
+        void* p = memory_pool_alloc(n * sizeof(T), alignof(T));
+        if (!p) fail();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_type) noexcept
+    {
+        memory_pool_free(p);
+    }
+
+private:
+    [[noreturn]] static void fail()
+    {
+#if defined(__cpp_exceptions)
+        throw std::bad_alloc();
+#else
+        abort();   // CONFIG_COMPILER_CXX_EXCEPTIONS ปิดอยู่ (ค่า default ของ ESP-IDF)
+#endif
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return true; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return false; }
@@ -0,0 +1,68 @@
+// pool_allocator_bench.cpp — std::list / std::map: PoolAllocator<T> vs std::allocator
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "pool_allocator.hpp"
+
+static const char *TAG = "MEM_POOLS";
+
+/* N ต่อรอบให้ node อยู่ใน Small pool ได้ทั้งหมด (ไม่งั้นวัดได้แต่ heap fallback) */
+#define ALLOC_BENCH_NODES   32
+#define ALLOC_BENCH_ROUNDS  50
+
+template <typename List>
+static double bench_list()
+{
+    List l;
+    uint64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < ALLOC_BENCH_ROUNDS; r++) {
+        for (int i = 0; i < ALLOC_BENCH_NODES; i++) l.push_back(i);
+        while (!l.empty()) l.pop_front();
+    }
+    return (double)(esp_timer_get_time() - t0) / (ALLOC_BENCH_ROUNDS * ALLOC_BENCH_NODES * 2);
+}
+
+template <typename Map>
+static double bench_map()
+{
+    Map m;
+    uint64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < ALLOC_BENCH_ROUNDS; r++) {
+        for (int i = 0; i < ALLOC_BENCH_NODES; i++) m.emplace((i * 7919) % 1000, i);
+        for (int i = 0; i < ALLOC_BENCH_NODES; i++) m.erase((i * 7919) % 1000);
+    }
+    return (double)(esp_timer_get_time() - t0) / (ALLOC_BENCH_ROUNDS * ALLOC_BENCH_NODES * 2);
+}
+
+/* node อยู่พูลไหนจริง: value อยู่ในตัว node จึงใช้ address ของ value หาพูลเจ้าของได้ */
+template <typename Map>
+static const char* map_node_owner()
+{
+    Map m;
+    m.emplace(1, 1);
+    return memory_pool_owner_name(&*m.begin());
+}
+
+extern "C" void pool_allocator_benchmark(void)
+{
+    using PoolList = std::list<int, PoolAllocator<int>>;
+    using PoolMap  = std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>>;
+    /* node ต้อง align 8 (double): พูลที่ alignment 4 ไม่รับ -> heap แบบ aligned ไม่ใช่ Huge */
+    using PoolMapD = std::map<int, double, std::less<int>, PoolAllocator<std::pair<const int, double>>>;
+
+    double list_heap  = bench_list<std::list<int>>();
+    double list_pool  = bench_list<PoolList>();
+    double map_heap   = bench_map<std::map<int, int>>();
+    double map_pool   = bench_map<PoolMap>();
+    double mapd_heap  = bench_map<std::map<int, double>>();
+    double mapd_pool  = bench_map<PoolMapD>();
+
+    ESP_LOGI(TAG, "C++ std::list push/pop: std::allocator %.2f us/op, PoolAllocator %.2f us/op", list_heap, list_pool);
+    ESP_LOGI(TAG, "C++ std::map<int,int> insert/erase: std::allocator %.2f us/op, PoolAllocator %.2f us/op (node -> %s)",
+             map_heap, map_pool, map_node_owner<PoolMap>());
+    ESP_LOGI(TAG, "C++ std::map<int,double> insert/erase: std::allocator %.2f us/op, PoolAllocator %.2f us/op (node -> %s, align %u)",
+             mapd_heap, mapd_pool, map_node_owner<PoolMapD>(), (unsigned)alignof(std::pair<const int, double>));
+}
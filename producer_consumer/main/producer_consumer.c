@@ -10,6 +10,7 @@
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "esp_random.h"
+#include "indicator.h"
 
 static const char *TAG = "PROD_CONS";
 
@@ -86,9 +87,7 @@ void producer_task(void *pvParameters) {
             global_stats.produced++;
             safe_printf("✓ Producer %d: Created %s (proc: %d ms)\n",
                         producer_id, product.product_name, product.processing_time_ms);
-            gpio_set_level(led_pin, 1);
-            vTaskDelay(pdMS_TO_TICKS(50));
-            gpio_set_level(led_pin, 0);
+            indicator_pulse(led_pin, 50);
         } else {
             global_stats.dropped++;
             safe_printf("✗ Producer %d: Queue full → Dropped %s\n",
@@ -199,6 +198,7 @@ void app_main(void) {
     gpio_set_level(LED_PRODUCER_4, 0);
     gpio_set_level(LED_CONSUMER_1, 0);
     gpio_set_level(LED_CONSUMER_2, 0);
+    indicator_init(INDICATOR_TASK_PRIORITY);
 
     // สร้าง Queue และ Mutex
     xProductQueue = xQueueCreate(10, sizeof(product_t));
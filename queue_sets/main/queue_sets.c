@@ -8,6 +8,7 @@
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "esp_random.h"
+#include "indicator.h"
 
 static const char *TAG = "QUEUE_SETS";
 
@@ -69,9 +70,7 @@ void sensor_task(void *pvParameters) {
         sensor_data.timestamp = xTaskGetTickCount();
         if (xQueueSend(xSensorQueue, &sensor_data, pdMS_TO_TICKS(100)) == pdPASS) {
             ESP_LOGI(TAG, "📊 Sensor: T=%.1f°C H=%.1f%%", sensor_data.temperature, sensor_data.humidity);
-            gpio_set_level(LED_SENSOR, 1);
-            vTaskDelay(pdMS_TO_TICKS(50));
-            gpio_set_level(LED_SENSOR, 0);
+            indicator_pulse(LED_SENSOR, 50);
         }
         vTaskDelay(pdMS_TO_TICKS(2000 + (esp_random() % 3000)));
     }
@@ -88,9 +87,7 @@ void user_input_task(void *pvParameters) {
         if (xQueueSend(xUserQueue, &user_input, pdMS_TO_TICKS(100)) == pdPASS) {
             ESP_LOGI(TAG, "🔘 User: Button %d pressed for %d ms",
                      user_input.button_id, user_input.duration_ms);
-            gpio_set_level(LED_USER, 1);
-            vTaskDelay(pdMS_TO_TICKS(80));
-            gpio_set_level(LED_USER, 0);
+            indicator_pulse(LED_USER, 80);
         }
         vTaskDelay(pdMS_TO_TICKS(3000 + (esp_random() % 5000)));
     }
@@ -110,9 +107,7 @@ void network_task(void *pvParameters) {
         if (xQueueSend(xNetworkQueue, &network_msg, pdMS_TO_TICKS(100)) == pdPASS) {
             ESP_LOGI(TAG, "🌐 Network [%s]: %s (P:%d)",
                      network_msg.source, network_msg.message, network_msg.priority);
-            gpio_set_level(LED_NETWORK, 1);
-            vTaskDelay(pdMS_TO_TICKS(40));
-            gpio_set_level(LED_NETWORK, 0);
+            indicator_pulse(LED_NETWORK, 40);
         }
         if (NETWORK_FAST_MODE)
             vTaskDelay(pdMS_TO_TICKS(500));   // ส่งทุก 0.5 วินาที
@@ -128,9 +123,7 @@ void timer_task(void *pvParameters) {
         vTaskDelay(pdMS_TO_TICKS(10000));
         xSemaphoreGive(xTimerSemaphore);
         ESP_LOGI(TAG, "⏰ Timer event triggered");
-        gpio_set_level(LED_TIMER, 1);
-        vTaskDelay(pdMS_TO_TICKS(80));
-        gpio_set_level(LED_TIMER, 0);
+        indicator_pulse(LED_TIMER, 80);
     }
 }
 
@@ -182,6 +175,7 @@ void app_main(void) {
     gpio_set_direction(LED_NETWORK, GPIO_MODE_OUTPUT);
     gpio_set_direction(LED_TIMER, GPIO_MODE_OUTPUT);
     gpio_set_direction(LED_PROCESSOR, GPIO_MODE_OUTPUT);
+    indicator_init(INDICATOR_TASK_PRIORITY);
 
     xSensorQueue = xQueueCreate(5, sizeof(sensor_data_t));
     xUserQueue = xQueueCreate(3, sizeof(user_input_t));
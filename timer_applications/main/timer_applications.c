@@ -12,6 +12,7 @@
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 #include "esp_random.h"
+#include "indicator.h"
 #include "esp_system.h"
 
 static const char *TAG = "TIMER_APPS";
@@ -98,12 +99,8 @@ static void watchdog_timeout_callback(TimerHandle_t timer) {
     ESP_LOGE(TAG, "System stats: Feeds=%lu, Timeouts=%lu",
              health_stats.watchdog_feeds, health_stats.watchdog_timeouts);
 
-    for (int i = 0; i < 10; i++) {
-        gpio_set_level(WATCHDOG_LED, 1);
-        vTaskDelay(pdMS_TO_TICKS(50));
-        gpio_set_level(WATCHDOG_LED, 0);
-        vTaskDelay(pdMS_TO_TICKS(50));
-    }
+    // กระพริบ 10 ครั้งผ่าน indicator service: timer daemon ไม่ต้องค้าง 1 วินาที
+    indicator_pattern(WATCHDOG_LED, 50, 50, 10);
 
     ESP_LOGW(TAG, "In production: esp_restart() would be called here");
 
@@ -134,9 +131,7 @@ static void feed_watchdog_callback(TimerHandle_t timer) {
 
     xTimerReset(watchdog_timer, 0);
 
-    gpio_set_level(STATUS_LED, 1);
-    vTaskDelay(pdMS_TO_TICKS(50));
-    gpio_set_level(STATUS_LED, 0);
+    indicator_pulse(STATUS_LED, 50);
 }
 
 static void recovery_callback(TimerHandle_t timer) {
@@ -308,9 +303,7 @@ static void status_timer_callback(TimerHandle_t timer) {
     ESP_LOGI(TAG, "  Sensor: %s", xTimerIsTimerActive(sensor_timer) ? "ACTIVE" : "INACTIVE");
     ESP_LOGI(TAG, "════════════════════════════\n");
 
-    gpio_set_level(STATUS_LED, 1);
-    vTaskDelay(pdMS_TO_TICKS(200));
-    gpio_set_level(STATUS_LED, 0);
+    indicator_pulse(STATUS_LED, 200);
 }
 
 // ================= PROCESSING TASKS =================
@@ -392,6 +385,7 @@ static void init_hardware(void) {
     gpio_set_level(PATTERN_LED_2, 0);
     gpio_set_level(PATTERN_LED_3, 0);
     gpio_set_level(SENSOR_POWER, 0);
+    indicator_init(INDICATOR_TASK_PRIORITY);
 
     // ใช้ ATTEN รุ่นใหม่เพื่อลดคำเตือน deprecate
     adc1_config_width(ADC_WIDTH_BIT_12);